@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <stdexcept>
+namespace CLI {
+struct ParseError : std::runtime_error { ParseError(std::string s):std::runtime_error(s){} };
+struct Formatter { void column_width(int){} };
+struct Option {
+  std::vector<std::string> names; bool is_flag; bool *b=nullptr; std::string *s=nullptr;
+  Option *take_last(){return this;} Option *needs(Option*){return this;}
+};
+struct App {
+  std::vector<std::unique_ptr<Option>> opts; std::shared_ptr<Formatter> f=std::make_shared<Formatter>();
+  App(std::string){}
+  std::shared_ptr<Formatter> get_formatter(){return f;}
+  static std::vector<std::string> split(std::string n){std::vector<std::string> r; size_t p=0; while(true){auto q=n.find(',',p); r.push_back(n.substr(p,q-p)); if(q==std::string::npos)break; p=q+1;} return r;}
+  Option *add_flag(std::string n, bool &b, std::string=""){ b=false; auto o=std::make_unique<Option>(); o->names=split(n); o->is_flag=true; o->b=&b; opts.push_back(std::move(o)); return opts.back().get();}
+  Option *add_option(std::string n, std::string &s, std::string="", bool=false){ auto o=std::make_unique<Option>(); o->names=split(n); o->is_flag=false; o->s=&s; opts.push_back(std::move(o)); return opts.back().get();}
+  Option *find(std::string a){ for(auto &o:opts) for(auto &n:o->names) if(n==a) return o.get(); return nullptr;}
+  void parse(int argc, char **argv){ for(int i=1;i<argc;++i){ std::string a=argv[i]; auto o=find(a); if(!o) throw ParseError("unknown "+a); if(o->is_flag) *o->b=true; else { if(i+1>=argc) throw ParseError("missing"); *o->s=argv[++i]; } } }
+  int exit(const ParseError &e){ fprintf(stderr,"%s\n",e.what()); return 1;}
+};
+}
+#define CLI11_PARSE(app,argc,argv) try{(app).parse(argc,argv);}catch(const CLI::ParseError&e){return (app).exit(e);}
@@ -1,4 +1,5 @@
 #include "base.h"
+#include <cstring>
 #include <iostream>
 
 using namespace std;
@@ -10,6 +11,33 @@ namespace sxako {
   void report_error(string message, string error)
     { cout << endl << message << ": " << error << endl; }
 
+  u64 hash_bytes(void const *data, size_t size) {
+    // MurmurHash64A, by Austin Appleby (public domain), with seed 0; it reads
+    // eight bytes at a time, and "memcpy()" avoids misaligned loads
+    u64 const m=0xc6a4a7935bd1e995;
+    unsigned const r=47;
+    u64 h=size*m;
+    auto p=static_cast<unsigned char const *>(data);
+    for (auto end=p+size/8*8; p not_eq end; p+=8) {
+      u64 k;
+      memcpy(&k, p, 8);
+      k*=m;
+      k^=k>>r;
+      k*=m;
+      h^=k;
+      h*=m;
+    }
+    if (size%8) {
+      for (size_t i=size%8; i--;)
+        h^=u64(p[i])<<(8*i);
+      h*=m;
+    }
+    h^=h>>r;
+    h*=m;
+    h^=h>>r;
+    return h;
+  }
+
   input_f input(std::istream &is)
     { return [&is]() { string s; getline(is, s); return s; }; }
   output_f output(std::ostream &os)
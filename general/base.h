@@ -408,6 +408,12 @@ namespace sxako {
   template <typename... T>
   constexpr auto &get_z(std::tuple<T...> &tu) { return std::get<2>(tu); }
 
+  /// hash_bytes()
+
+  // a 64-bit hash of raw bytes (MurmurHash64A), for hashing data repositories
+  // without copying them into strings
+  u64 hash_bytes(void const *data, size_t size);
+
   /// functions for text-based input and output
   using input_f=std::function<std::string ()>;      // reads by lines
   using output_f=std::function<void (std::string)>; // doesn't add "\n"
@@ -1,6 +1,7 @@
 #include <iostream>
 #include "straight.h"
 #include "think.h"
+#include "piece_game.h"
 
 using namespace std;
 using namespace sxako;
@@ -102,4 +103,42 @@ int main(int, char *[]) {
     cout << "cheking default algorithm params: "
          << (AlgorithmParams()==AlgorithmParams(default_params_s)) << endl;
   }
+  {
+    using namespace piece_2d_game;
+    cout << "sliding attacks tests" << endl;
+    // the tables, whatever their indexing, against the walked attacks, for
+    // random occupancies (from dense to sparse)
+    auto check_slide_attacks=[](SlideAttacks const &tables) {
+      using bitboard_t=SlideAttacks::bitboard_t;
+      series<Displacement> const slider_steps[2]={
+        {{ 0, +1}, {-1,  0}, {+1,  0}, { 0, -1}},
+        {{-1, +1}, {+1, +1}, {-1, -1}, {+1, -1}}};
+      mt19937_64 random(21);
+      for (unsigned n=0; n<1200; ++n) {
+        bitboard_t occupied=random();
+        for (unsigned sparser=0; sparser<n%3; ++sparser)
+          occupied&=random();
+        for (index_t k=0; k<2; ++k)
+          for (index_t from=0; from<64; ++from) {
+            bitboard_t all_steps=0;
+            for (Displacement dis: slider_steps[k]) {
+              bitboard_t walked=SlideAttacks::walk(from, dis, occupied);
+              if (tables.attacks(dis, from, occupied) not_eq walked)
+                return false;
+              all_steps|=walked;
+            }
+            if (tables.attacks(SlideAttacks::Slider(k), from, occupied)
+                not_eq all_steps)
+              return false;
+          }
+      }
+      return true;
+    };
+    SlideAttacks const magic_tables(false), pext_tables(true);
+    cout << "checking sliding attacks with magic numbers: "
+         << (not magic_tables.uses_pext()
+             and check_slide_attacks(magic_tables)) << endl;
+    cout << "checking sliding attacks with pext (if available): "
+         << check_slide_attacks(pext_tables) << endl;
+  }
 }
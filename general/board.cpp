@@ -23,8 +23,6 @@ namespace sxako {
 #undef case
   }
 
-  std::hash<std::string> Board::hasher;
-
   namespace {
 
     template <typename LM, typename WR>
@@ -6,6 +6,8 @@
 #include <iosfwd>
 #include <list>
 #include <functional>
+#include <iterator>
+#include <vector>
 
 namespace sxako {
 
@@ -103,6 +105,13 @@ namespace sxako {
 
   class Board;
 
+  // the keys ("Board::id_hash()") of the positions along a line of play, the
+  // last one being the current position's; it's kept apart from the boards,
+  // and grows and shrinks with the line (in "Game" for the game, and in the
+  // searches for the lines they explore), for the rules that depend on the
+  // positions that led to a board (e.g., draw by repetition)
+  using PositionPath=std::vector<u64>;
+
   // meta-game info: last move (number and representation)
   struct LastMove {
     unsigned number=0;
@@ -142,12 +151,28 @@ namespace sxako {
     enum class Outcome { playing, draw, last_move_won, last_move_lost };
     friend std::ostream &operator<<(std::ostream &os, Rules::Outcome o);
     std::function<Outcome (Board const &)> const outcome;
+    // whether the current position is a draw by repetition, given the
+    // positions that led to it; it may be left empty
+    std::function<bool (Board const &, PositionPath const &)> const repeated;
 
     // apply a move to a game situation; must maintain the cache
     std::function<void (Board &, Move const &)> const move;
 
     // list of _all_ legal moves from a game situation
     std::function<Moves (Board const &)> const legal_moves;
+    // current outcome, plus the list of legal moves if the game isn't
+    // finished, in one go; games that can share work between the two
+    // computations (e.g., looking for checkmate) provide it; it may be left
+    // empty, and "Game" then resorts to "outcome" and "legal_moves"
+    std::function<Outcome (Board const &, Moves &)> const
+      outcome_and_legal_moves;
+    // current outcome, plus one uniformly random legal move if the game isn't
+    // finished, without necessarily generating the list of legal moves (as for
+    // random playouts); "random(n)" must return a uniformly random number in
+    // [0, n); it may be left empty, and "Game" then picks from the list
+    using random_index_f=std::function<size_t (size_t n)>;
+    std::function<Outcome (Board const &, Move &, random_index_f const &)>
+      const outcome_and_random_legal_move;
 
     // two-way conversion between move and string; depends on the current game
     // situation
@@ -183,9 +208,12 @@ namespace sxako {
     decltype(auto) operator()(Ptr const &p) { return operator()(*p); }
 
     // id identifying the current state; good for keeping track of evaluated
-    // situations; since it's a string, it's readily hashable
+    // situations; since it's a string, it's readily hashable; "id_view()"
+    // and "id_hash()" work on the state in place, without allocating
     std::string id() const { return data.data<Kind::state>().id(); }
-    auto id_hash() const { return hasher(id()); }
+    std::string_view id_view() const
+      { return data.data<Kind::state>().id_view(); }
+    u64 id_hash() const { return data.data<Kind::state>().id_hash(); }
 
     // reset cache to reflect current state, using the provided function; used
     // by "Game" to initialise
@@ -198,7 +226,6 @@ namespace sxako {
     bool check_cache(F const &f) const
       { return data.data<Kind::cache>()==f(data.data<Kind::state>()); }
   private:
-    static std::hash<std::string> hasher;
     DataStore<Rules::DataSpec> data;
   };
 
@@ -213,6 +240,8 @@ namespace sxako {
       : rules(rules), situation(rules.data_spec) {
       rules.initialize(situation.board);
       situation.board.reset_cache(rules.compute_cache);
+      game_path.push_back(situation.board.id_hash());
+      snapshots.push_back(situation);
     }
 
     Rules const rules;
@@ -225,9 +254,53 @@ namespace sxako {
     // turn (who's to play)
     Color turn() const { return board()(rules.turn); }
 
-    // outcome computation
-    Rules::Outcome outcome(Board const &b) const { return rules.outcome(b); }
-    Rules::Outcome outcome() const { return outcome(board()); }
+    // the positions of the game so far, the current one included
+    PositionPath const &path() const { return game_path; }
+
+    // outcome computation; "path" holds the positions that led to "b" (see
+    // "PositionPath"); without it, repetitions can't be told
+    Rules::Outcome outcome(Board const &b,
+                           PositionPath const &path={}) const {
+      return
+        repeated(b, path)
+        ? Rules::Outcome::draw
+        : rules.outcome(b);
+    }
+    Rules::Outcome outcome() const { return outcome(board(), path()); }
+    // whether "b" repeats a position of "path" (a draw, on that path only)
+    bool repeated(Board const &b, PositionPath const &path) const {
+      return
+        rules.repeated and not path.empty() and rules.repeated(b, path);
+    }
+    // outcome, and the legal moves too if still playing (otherwise, "moves" is
+    // left untouched)
+    Rules::Outcome outcome_and_legal_moves(Board const &b, Moves &moves,
+                                           PositionPath const &path={}) const {
+      if (repeated(b, path))
+        return Rules::Outcome::draw;
+      if (rules.outcome_and_legal_moves)
+        return rules.outcome_and_legal_moves(b, moves);
+      auto o=outcome(b);
+      if (o==Rules::Outcome::playing)
+        moves=legal_moves(b);
+      return o;
+    }
+    // outcome, and a uniformly random legal move too if still playing
+    // (otherwise, "m" is left untouched)
+    Rules::Outcome
+    outcome_and_random_legal_move(Board const &b, Move &m,
+                                  Rules::random_index_f const &random,
+                                  PositionPath const &path={}) const {
+      if (repeated(b, path))
+        return Rules::Outcome::draw;
+      if (rules.outcome_and_random_legal_move)
+        return rules.outcome_and_random_legal_move(b, m, random);
+      Moves moves;
+      auto o=outcome_and_legal_moves(b, moves);
+      if (o==Rules::Outcome::playing)
+        m=*std::next(moves.begin(), random(moves.size()));
+      return o;
+    }
 
     // apply move to game situation:
     void move(Board &b, Move const &m) const {
@@ -235,17 +308,25 @@ namespace sxako {
       assert(situation.board.check_cache(rules.compute_cache));
     }
     void move(Move const &m) {
-      history.push_back(situation);
-      ++situation.last_move.number;
-      situation.last_move.move=rules.write_move(situation.board, m);
-      move(situation.board, m);
+      play(m, true);
+      moves_played.push_back(m);
+      game_path.push_back(situation.board.id_hash());
+      if (moves_played.size()%snapshot_interval==0)
+        snapshots.push_back(situation);
     }
 
-    // undo last move of the game (not available for game-less board)
+    // undo last move of the game (not available for game-less board); the
+    // situation is rebuilt from the last snapshot before it
     void undo_last_move() {
-      if (not history.empty()) {
-        situation=history.back();
-        history.pop_back();
+      if (not moves_played.empty()) {
+        moves_played.pop_back();
+        game_path.pop_back();
+        auto n=moves_played.size();
+        snapshots.erase(snapshots.begin()+s_index_t(n/snapshot_interval+1),
+                        snapshots.end());
+        situation=snapshots.back();
+        for (auto i=n/snapshot_interval*snapshot_interval; i<n; ++i)
+          play(moves_played[i], i+1==n);
       }
     }
 
@@ -277,7 +358,21 @@ namespace sxako {
       Board board;
       LastMove last_move;
     } situation;
-    std::list<Situation> history;
+    // play "m" on the game situation, writing it down as the last move if
+    // "write" (otherwise, the last move is left stale)
+    void play(Move const &m, bool write) {
+      ++situation.last_move.number;
+      if (write)
+        situation.last_move.move=rules.write_move(situation.board, m);
+      move(situation.board, m);
+    }
+    // the history of the game is kept as the moves played, plus a snapshot
+    // of the situation every "snapshot_interval" moves (the first one being
+    // the initial situation), from which to replay them
+    static constexpr size_t snapshot_interval=32;
+    std::vector<Move> moves_played;
+    std::vector<Situation> snapshots;
+    PositionPath game_path;
   };
 
   // default "parse_move()" implementation: return the only legal move that
@@ -78,7 +78,7 @@ namespace sxako::chess {
       : Piece2DGameData {
       CaissaBritanniaData()
         : Piece2DGameData(caissa_britannia_piece_box,
-                          make_pair(1, 10), make_pair(1, 10)) { }
+                          padding_t{2}, make_pair(1, 10), make_pair(1, 10)) { }
 
       Move_king king_m{*this};
       Move_rook_knight_bishop rook_knight_bishop_m{*this};
@@ -204,8 +204,14 @@ namespace sxako::chess {
         initialize_caissa_britannia,
         [](Data<Kind::state> const &state) { return d.compute_cache(state); },
         [](Board const &b) { return d.outcome(b); },
+        [](Board const &b, PositionPath const &path)
+          { return d.repeated(b, path); },
         [](Board &b, Move const &m) { d.board_move(b, m); },
         [](Board const &b) { return d.legal_moves(b); },
+        [](Board const &b, Moves &moves)
+          { return d.outcome_and_legal_moves(b, moves); },
+        [](Board const &b, Move &m, Rules::random_index_f const &random)
+          { return d.outcome_and_random_legal_move(b, m, random); },
         write_move,
         parse_move_default([](Board const &b) { return d.legal_moves(b); },
                            write_move),
@@ -32,7 +32,7 @@ namespace {
       : Piece2DGameData {
       FideData()
         : Piece2DGameData(fide_piece_box,
-                          make_pair(1, 8), make_pair(1, 8)) { }
+                          padding_t{2}, make_pair(1, 8), make_pair(1, 8)) { }
 
       Move_i_rook_king_and_castling i_rook_king_and_castling_m{*this};
       Move_rook_knight_bishop_queen rook_knight_bishop_queen_m{*this};
@@ -57,6 +57,8 @@ namespace {
         {white_promotion, black_promotion},
         {w_i_pawn_advance_steps, b_i_pawn_advance_steps}};
 
+      FideAttackMap fide_attack_map{*this};
+
       LimitedRepetition limited_repetition{
         *this, 50, {"w_i_pawn"_sq, "w_pawn"_sq, "b_i_pawn"_sq, "b_pawn"_sq}};
     } fide_data;
@@ -223,14 +225,14 @@ namespace {
         for (auto s: d.piece_box.enumerated_occupied_squares)
           if (d.color_of(s)==c)
             material+=
-              b(d.square_count.counts)[s]*int(piece_value.at(d.piece_of(s)));
+              int(d.count(b, s))*int(piece_value.at(d.piece_of(s)));
 
         Location king_l;
         int position=0;
-        for (auto l: d.squares.all_enumerated_coords) {
-          Square s=b(d.squares)[l];
-          if (d.is_occupied(s) and d.color_of(s)==c)
-            switch (d.piece_of(s)) {
+        d.piece_squares.for_each(
+          b, c, false,
+          [&](Location l) {
+            switch (d.piece_of(b(d.squares)[l])) {
             case 'p': position+=tables(pawn_diff)[l];   break;
             case 'n': position+=tables(knight_diff)[l]; break;
             case 'b': position+=tables(bishop_diff)[l]; break;
@@ -239,7 +241,8 @@ namespace {
             case 'k': king_l=l; break;
             default: break;
             }
-        }
+            return false;
+          });
 
         float king_end_factor=king_endness(material);
         score_t king_position=
@@ -365,8 +368,14 @@ Michniewski evaluation
       initialize,
       [&d](Data<Kind::state> const &state) { return d.compute_cache(state); },
       [&d](Board const &b) { return d.outcome(b); },
+      [&d](Board const &b, PositionPath const &path)
+        { return d.repeated(b, path); },
       [&d](Board &b, Move const &m) { d.board_move(b, m); },
       [&d](Board const &b) { return d.legal_moves(b); },
+      [&d](Board const &b, Moves &moves)
+        { return d.outcome_and_legal_moves(b, moves); },
+      [&d](Board const &b, Move &m, Rules::random_index_f const &random)
+        { return d.outcome_and_random_legal_move(b, m, random); },
       write_move,
       parse_move_default([&d](Board const &b) { return d.legal_moves(b); },
                          write_move),
@@ -518,7 +527,7 @@ Michniewski evaluation
       : Piece2DGameData {
       ChessAttackData()
         : Piece2DGameData(chess_attack_piece_box,
-                          make_pair(1, 5), make_pair(1, 6)) { }
+                          padding_t{2}, make_pair(1, 5), make_pair(1, 6)) { }
 
       Move_i_rook_king_and_castling i_rook_king_and_castling_m{*this};
       Move_rook_knight_bishop_queen rook_knight_bishop_queen_m{*this};
@@ -551,6 +560,8 @@ Michniewski evaluation
         {white_promotion, black_promotion},
         {w_i_pawn_advance_steps, b_i_pawn_advance_steps}};
 
+      FideAttackMap fide_attack_map{*this};
+
       LimitedRepetition limited_repetition{
         *this, 50, {"w_i_pawn"_sq, "w_pawn"_sq, "b_i_pawn"_sq, "b_pawn"_sq}};
     } chess_attack_data;
@@ -0,0 +1,93 @@
+#include "clock.h"
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sxako {
+
+  namespace {
+
+    seconds_t seconds_since(chrono::steady_clock::time_point t) {
+      return chrono::duration<seconds_t>(chrono::steady_clock::now()-t)
+        .count();
+    }
+
+  }
+
+  TimeControl::TimeControl(string spec) {
+    string rest=spec;
+    try {
+      auto slash=rest.find('/');
+      if (slash not_eq string::npos) {
+        moves=from_text<unsigned>(rest.substr(0, slash));
+        if (moves==0)
+          throw invalid_argument("zero moves per period");
+        rest.erase(0, slash+1);
+      }
+      auto plus=rest.find('+');
+      if (plus not_eq string::npos) {
+        increment=from_text<seconds_t>(rest.substr(plus+1));
+        rest.erase(plus);
+      }
+      period=from_text<seconds_t>(rest);
+    }
+    catch (invalid_argument const &error) {
+      throw invalid_argument("wrong time control \""+spec+"\" ("
+                             +error.what()+")");
+    }
+    if (not (period>0.) or increment<0.)
+      throw invalid_argument("wrong time control \""+spec
+                             +"\" (non-positive time)");
+  }
+
+  Clock::Clock(TimeControl time_control)
+    : time_control(time_control), left(time_control.period) { }
+
+  void Clock::start() {
+    if (running)
+      throw logic_error("clock already running");
+    running=true;
+    started=steady_clock::now();
+  }
+
+  bool Clock::stop() {
+    if (not running)
+      throw logic_error("clock not running");
+    left-=seconds_since(started);
+    running=false;
+    if (left<0.)
+      return false;
+    ++n_moves;
+    left+=time_control.increment;
+    if (time_control.moves and n_moves%time_control.moves==0)
+      left+=time_control.period;
+    return true;
+  }
+
+  seconds_t Clock::remaining() const
+    { return running ? left-seconds_since(started) : left; }
+
+  unsigned Clock::moves_to_go() const {
+    return
+      time_control.moves
+      ? time_control.moves-n_moves%time_control.moves
+      : 0;
+  }
+
+  Deadline::Deadline(seconds_t from_now)
+    : none(false), duration(from_now) { }
+
+  bool Deadline::passed() const
+    { return not none and elapsed()>=duration; }
+
+  seconds_t Deadline::elapsed() const { return seconds_since(created); }
+
+  seconds_t Deadline::remaining() const {
+    return
+      none
+      ? numeric_limits<seconds_t>::infinity()
+      : duration-elapsed();
+  }
+
+}
@@ -0,0 +1,66 @@
+#ifndef SXAKO_CLOCK_HEADER_
+#define SXAKO_CLOCK_HEADER_
+
+#include "base.h"
+#include <chrono>
+#include <string>
+
+namespace sxako {
+
+  // "seconds_t" is the general type for durations
+  using seconds_t=double;
+
+  // a time control, specified with the syntax "[<moves>/]<seconds>[+<inc>]":
+  //   "300": sudden death; 300 s for the whole game
+  //   "300+2": sudden death with increment; 2 s added after each move
+  //   "40/5400": moves per period; 5400 s added every 40 moves
+  //   "40/5400+30": moves per period with increment
+  struct TimeControl {
+    TimeControl(std::string spec);
+    unsigned moves=0; // moves per period; 0 for sudden death
+    seconds_t period=0., increment=0.;
+  };
+
+  // a chess clock for one player; it only runs between "start()" and "stop()"
+  class Clock {
+  public:
+    Clock(TimeControl time_control);
+    TimeControl const time_control;
+    void start();
+    // stop the clock after a move, and add the increment and the next period
+    // (if due); return "false" if the flag fell before the move was made
+    bool stop();
+    // time left (if running, as of now)
+    seconds_t remaining() const;
+    // moves until the next period starts (0 for sudden death)
+    unsigned moves_to_go() const;
+    unsigned moves_played() const { return n_moves; }
+  private:
+    using steady_clock=std::chrono::steady_clock;
+    seconds_t left;
+    unsigned n_moves=0;
+    bool running=false;
+    steady_clock::time_point started;
+  };
+
+  // a point in time after which some computation must stop; the
+  // default-constructed deadline is never reached
+  class Deadline {
+  public:
+    Deadline()=default;
+    Deadline(seconds_t from_now);
+    bool passed() const;
+    // time since construction
+    seconds_t elapsed() const;
+    // time to go until the deadline (infinite if there's no deadline)
+    seconds_t remaining() const;
+  private:
+    using steady_clock=std::chrono::steady_clock;
+    steady_clock::time_point const created=steady_clock::now();
+    bool const none=true;
+    seconds_t const duration=0.;
+  };
+
+}
+
+#endif
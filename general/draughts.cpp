@@ -40,6 +40,22 @@ namespace sxako::draughts {
       return;
     series<Displacement> const &steps=get<0>(pawn_specs);
     promotion_f const &promotion=get<1>(pawn_specs);
+    if (Bitboards const *bitboards=d.bitboards;
+        bitboards and Bitboards::are_leaps(steps)) {
+      // the same moves, in the same order, from the bitboards
+      auto const occupied=bitboards->occupied(b);
+      index_t const from=bitboards->bit(l);
+      for (Displacement dis: steps)
+        if (index_t i=bitboards->leap(from, dis);
+            i not_eq Bitboards::no_bit and not (occupied>>i&1)) {
+          Location to=bitboards->location(i);
+          if (add_piece_move(d, b, add_move,
+                             make_move(l, to, l_s, change_to), to,
+                             {}, promotion))
+            return;
+        }
+      return;
+    }
     for (Displacement dis: steps) {
       Location to=l+dis;
       if (Square s;
@@ -71,13 +87,38 @@ namespace sxako::draughts {
                                     Color c, Location l,
                                     Square l_s, Square change_to) {
       bool no_capture=true;
+      // the captures are found on the bitboards, if any
+      Bitboards const *bitboards=
+        Bitboards::are_leaps(steps) ? d.bitboards : nullptr;
+      Bitboards::bitboard_t enemies=0, occupied=0;
+      index_t from=0;
+      if (bitboards) {
+        enemies=bitboards->occupied(b, enemy(c));
+        occupied=bitboards->occupied(b);
+        from=bitboards->bit(l);
+      }
+      auto can_capture=[&](Displacement dis, Location &capture, Location &to) {
+        if (bitboards) {
+          index_t capture_i=bitboards->leap(from, dis), to_i;
+          if (capture_i==Bitboards::no_bit or not (enemies>>capture_i&1)
+              or (to_i=bitboards->leap(capture_i, dis))==Bitboards::no_bit
+              or occupied>>to_i&1)
+            return false;
+          capture=bitboards->location(capture_i);
+          to=bitboards->location(to_i);
+          return true;
+        }
+        capture=l+dis;
+        to=capture+dis;
+        Square capture_s, to_s;
+        return
+          b(d.squares).get_if_contains(capture, capture_s)
+          and b(d.squares).get_if_contains(to, to_s)
+          and d.is_occupied(capture_s) and d.color_of(capture_s) not_eq c
+          and not d.is_occupied(to_s);
+      };
       for (Displacement dis: steps) {
-        Location capture=l+dis, to=capture+dis;
-        if (Square capture_s, to_s;
-            b(d.squares).get_if_contains(capture, capture_s)
-            and b(d.squares).get_if_contains(to, to_s)
-            and d.is_occupied(capture_s) and d.color_of(capture_s) not_eq c
-            and not d.is_occupied(to_s)) {
+        if (Location capture, to; can_capture(dis, capture, to)) {
           Board b_capturing=b;
           Move this_m=make_capture(capture)+make_move(l, to);
           d.move_handler.handle(b_capturing, this_m);
@@ -176,6 +217,7 @@ namespace sxako::draughts {
         ? series<Square>{"b_d-king"_sq}
         : series<Square>{};
     };
+    Bitboards bitboards{*this};
     Move_pawns pawn_m{*this, {white_promotion, black_promotion}};
     Move_kings king_m{*this};
 
@@ -272,8 +314,14 @@ namespace sxako::draughts {
       initialize,
       [&d](Data<Kind::state> const &state) { return d.compute_cache(state); },
       [&d](Board const &b) { return d.outcome(b); },
+      [&d](Board const &b, PositionPath const &path)
+        { return d.repeated(b, path); },
       [&d](Board &b, Move const &m) { d.board_move(b, m); },
       [&d](Board const &b) { return d.legal_moves(b); },
+      [&d](Board const &b, Moves &moves)
+        { return d.outcome_and_legal_moves(b, moves); },
+      [&d](Board const &b, Move &m, Rules::random_index_f const &random)
+        { return d.outcome_and_random_legal_move(b, m, random); },
       write_move,
       parse_move_default([&d](Board const &b) { return d.legal_moves(b); },
                          write_move),
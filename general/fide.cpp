@@ -10,11 +10,11 @@ namespace sxako::fide {
                       series<Square> irreversible_squares)
       : d(d), max_past_size(max_past_size),
         irreversible_squares(irreversible_squares),
-        past_size(d.manag_spec),
-        past_hash(d.manag_spec, std::make_pair(1, max_past_size)) {
+        past_size(d.manag_spec) {
       d.move_command_handler.append(f_funct(this, &this_t::move_handler));
       d.post_push_front_turn_handler(f_funct(this, &this_t::turn_handler));
       d.outcome_filters.append(f_funct(this, &this_t::outcome_filter));
+      d.repetition=f_funct(this, &this_t::repeated);
       d.initialization.append(f_funct(this, &this_t::reset));
     }
 
@@ -26,33 +26,30 @@ namespace sxako::fide {
   }
 
   void LimitedRepetition
-  ::turn_handler(Board &b) const {
-    auto new_ps=++b(past_size);
-    // this may be false when checking hypothetical moves (like "is there any
-    // legal move?"):
-    if (new_ps<=max_past_size)
-      b(past_hash)[new_ps]=b.id_hash();
-  }
+  ::turn_handler(Board &b) const
+    { ++b(past_size); }
 
   void LimitedRepetition
-  ::outcome_filter(Rules::Outcome &o, Board const &b) const {
-    if (o not_eq Rules::Outcome::playing)
-      return;
-    auto ps=b(past_size);
-    if (ps>=max_past_size) {
+  ::outcome_filter(Rules::Outcome &o, Board const &b,
+                   LazyLegalMoves &) const {
+    if (o==Rules::Outcome::playing and b(past_size)>=max_past_size)
       o=Rules::Outcome::draw;
-      return;
-    }
-    auto last_id_hash=b(past_hash)[ps];
-    for (auto i=ps-1; i>=1; --i)
-      if (b(past_hash)[i]==last_id_hash) {
-        o=Rules::Outcome::draw;
-        return;
-      }
   }
+
+  bool LimitedRepetition
+  ::repeated(Board const &b, PositionPath const &path) const {
+    // the path may start after the last irreversible move (e.g., in a
+    // setup position)
+    auto n=min(size_t(b(past_size)), path.size());
+    for (size_t i=2; i<=n; ++i)
+      if (path[path.size()-i]==path.back())
+        return true;
+    return false;
+  }
+
   void LimitedRepetition
   ::reset(Board &b) const
-    { b(past_hash)[b(past_size)=1]=b.id_hash(); }
+    { b(past_size)=1; }
 
 
   Mate::Mate(Piece2DGameData &d,
@@ -63,9 +60,9 @@ namespace sxako::fide {
       per_square_legal_moves_filter(per_square_legal_moves_filter)
     { d.outcome_filters.append(f_funct(this, &this_t::outcome_filter)); }
 
-  void Mate::outcome_filter(Rules::Outcome &o, Board const &b) const {
-    if (o==Rules::Outcome::playing
-        and not per_square_legal_moves_filter.is_there_any_legal_move(b)) {
+  void Mate::outcome_filter(Rules::Outcome &o, Board const &b,
+                            LazyLegalMoves &legal_moves) const {
+    if (o==Rules::Outcome::playing and not legal_moves.any()) {
       Color c=b(d.turn);
       Location king_l=b(track_kings.tracked_location)[c];
       o=per_square_legal_moves_filter.is_under_attack(b, king_l, c)
@@ -81,7 +78,8 @@ namespace sxako::fide {
     { d.outcome_filters.append(f_funct(this, &this_t::outcome_filter)); }
 
   void DrawIfRoyalsAlone
-  ::outcome_filter(Rules::Outcome &o, Board const &b) const {
+  ::outcome_filter(Rules::Outcome &o, Board const &b,
+                   LazyLegalMoves &) const {
     if (o==Rules::Outcome::playing) {
       for (auto s: d.piece_box.enumerated_occupied_squares)
         if (not is_in(s, royal_squares) and b(d.square_count.counts)[s])
@@ -104,6 +102,13 @@ namespace sxako::fide {
 
   bool AvoidCheck::in_check(Board const &b, Move m) const {
     Color attackee_color=b(d.turn);
+    // with an attack map, most moves can be cleared without making them
+    if (AttackMap const *attack_map=per_square_legal_moves_filter.attack_map;
+        attack_map
+        and attack_map->stays_safe(
+              b, m, b(track_kings.tracked_location)[attackee_color],
+              attackee_color))
+      return false;
     Board bm=b;
     d.board_move(bm, m);
     return per_square_legal_moves_filter.is_under_attack(
@@ -150,6 +155,37 @@ namespace sxako::fide {
       non_capturing_steps=get<0>(pawn_specs),
       capturing_steps=get<1>(pawn_specs);
     promotion_f const &promotion=get<2>(pawn_specs);
+    if (Bitboards const *bitboards=d.bitboards;
+        bitboards and Bitboards::are_leaps(capturing_steps)
+        and Bitboards::are_leaps(non_capturing_steps)) {
+      // the same moves, in the same order, from the bitboards
+      auto const
+        enemies=bitboards->occupied(b, enemy(c)),
+        occupied=bitboards->occupied(b);
+      index_t const from=bitboards->bit(l);
+      for (Displacement dis: capturing_steps)
+        if (index_t i=bitboards->leap(from, dis);
+            i not_eq Bitboards::no_bit and enemies>>i&1) {
+          Location to=bitboards->location(i);
+          if (add_pawn_move(d, b, add_move,
+                            make_capture(to)+make_move(l, to, l_s, change_to),
+                            to, {to},
+                            promotion))
+            return;
+        }
+      if (not only_capture)
+        for (Displacement dis: non_capturing_steps) {
+          index_t i=bitboards->leap(from, dis);
+          if (i==Bitboards::no_bit or occupied>>i&1)
+            break;
+          Location to=bitboards->location(i);
+          if (add_pawn_move(d, b, add_move,
+                            make_move(l, to, l_s, change_to), to, {},
+                            promotion))
+            return;
+        }
+      return;
+    }
     for (Displacement dis: capturing_steps) {
       Location to=l+dis;
       if (Square s;
@@ -362,7 +398,7 @@ namespace sxako::fide {
     for (auto s: d.piece_box.enumerated_occupied_squares) {
       score_t square_value=
         value(material_table, d.piece_of(s), d.color_of(s), my_c);
-      score+=b(d.square_count.counts)[s]*square_value;
+      score+=d.count(b, s)*square_value;
     }
     return score;
   }
@@ -404,19 +440,22 @@ only the piece value (a constant number for each piece) is considered
       b_prom_y=get<1>(square_range).first;
     Color my_c=enemy(b(d.turn)); // i've just played
     score_t score=just_material(d, b, material_table);
-    for (auto l: d.squares.all_enumerated_coords) {
-      Square s=b(d.squares)[l];
-      Piece s_p=d.piece_of(s);
-      Color s_c=d.color_of(s);
-      if (s_p=='p')
-        score-=
-          factor*value(material_table, s_p, s_c, my_c)
-          *distance(l, mid_x, s_c==Color::white ? w_prom_y : b_prom_y);
-      else
-        score-=
-          factor*value(material_table, s_p, s_c, my_c)
-          *distance(l, mid_x, mid_y);
-    }
+    d.piece_squares.for_each( // empty squares are worth nothing
+      b,
+      [&](Location l) {
+        Square s=b(d.squares)[l];
+        Piece s_p=d.piece_of(s);
+        Color s_c=d.color_of(s);
+        if (s_p=='p')
+          score-=
+            factor*value(material_table, s_p, s_c, my_c)
+            *distance(l, mid_x, s_c==Color::white ? w_prom_y : b_prom_y);
+        else
+          score-=
+            factor*value(material_table, s_p, s_c, my_c)
+            *distance(l, mid_x, mid_y);
+        return false;
+      });
     return score;
   }
 
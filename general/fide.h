@@ -8,6 +8,10 @@ namespace sxako::fide {
 
   using namespace piece_2d_game;
 
+  // a draw after "max_past_size" positions since the last irreversible move
+  // (a capture, or a move by one of "irreversible_squares"), or when the
+  // current position repeats one since then; the positions themselves aren't
+  // kept in the board, but in the "PositionPath" given to "repeated()"
   struct LimitedRepetition { using this_t=LimitedRepetition;
     LimitedRepetition(Piece2DGameData &d,
                       size_t max_past_size,
@@ -15,13 +19,14 @@ namespace sxako::fide {
     Piece2DGameData const &d;
     size_t const max_past_size;
     series<Square> const irreversible_squares;
+    // positions since the last irreversible move, the current one included
     Addressing<Kind::manag, SingleVar, size_t> const past_size;
-    using hash_t=size_t;
-    Addressing<Kind::manag, Straight<size_t>, hash_t> const past_hash;
   private:
     void move_handler(Board &b, Location from, Location to) const;
     void turn_handler(Board &b) const;
-    void outcome_filter(Rules::Outcome &o, Board const &b) const;
+    void outcome_filter(Rules::Outcome &o, Board const &b,
+                        LazyLegalMoves &) const;
+    bool repeated(Board const &b, PositionPath const &path) const;
     void reset(Board &b) const;
   };
 
@@ -34,7 +39,8 @@ namespace sxako::fide {
     TrackPiece const &track_kings;
     PerSquareLegalMovesFilter const &per_square_legal_moves_filter;
   private:
-    void outcome_filter(Rules::Outcome &o, Board const &b) const;
+    void outcome_filter(Rules::Outcome &o, Board const &b,
+                        LazyLegalMoves &legal_moves) const;
   };
 
   struct DrawIfRoyalsAlone { using this_t=DrawIfRoyalsAlone;
@@ -43,7 +49,8 @@ namespace sxako::fide {
     Piece2DGameData const &d;
     series<Square> const royal_squares;
   private:
-    void outcome_filter(Rules::Outcome &o, Board const &b) const;
+    void outcome_filter(Rules::Outcome &o, Board const &b,
+                        LazyLegalMoves &) const;
   };
 
   struct AvoidCheck { using this_t=AvoidCheck;
@@ -225,6 +232,23 @@ namespace sxako::fide {
                           {pb["b_pawn"], b_pawn_capture_steps}}};
   };
 
+  // the attacks of the FIDE pieces, for looking checks up rather than
+  // generating them (en passant is left out, since it can't capture a king)
+  struct FideAttackMap : Move_base {
+    using Move_base::Move_base;
+    AttackMap attack_map{
+      d,
+      {{{pb["w_i_king"], pb["w_king"], pb["b_i_king"], pb["b_king"]},
+        king_steps},
+       {{pb["w_knight"], pb["b_knight"]}, knight_steps},
+       {{pb["w_i_pawn"], pb["w_pawn"]}, w_pawn_capture_steps},
+       {{pb["b_i_pawn"], pb["b_pawn"]}, b_pawn_capture_steps}},
+      {{{pb["w_i_rook"], pb["w_rook"], pb["b_i_rook"], pb["b_rook"]},
+        rook_steps},
+       {{pb["w_bishop"], pb["b_bishop"]}, bishop_steps},
+       {{pb["w_queen"], pb["b_queen"]}, queen_steps}}};
+  };
+
   /// evaluation
   using material_table_t=std::map<Piece, score_t>;
 
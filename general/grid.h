@@ -3,7 +3,10 @@
 
 #include "base.h"
 #include <cstring>
+#include <new>
+#include <string_view>
 #include <type_traits>
+#include <vector>
 #include <cassert>
 
 namespace sxako {
@@ -49,7 +52,10 @@ namespace sxako {
   // gets an data repository access offset; when creating a "Data<kind>", its
   // size is given by the matching "DataSpec<kind>"; once a "DataSpec<>" is
   // read, it becomes "finalised", and it won't accept any additional data item
-  // addressing; all sizes at this level are in bytes
+  // addressing; all sizes at this level are in bytes; a "Data<kind>" created
+  // from a "DataSpec<kind>" is zero-initialised, except for the cells given
+  // an initial value with "set_initial()" (e.g., the sentinels in the padding
+  // of a board; see "StraightIndexing" in "straight")
   template <Kind kind>
   class DataSpec {
   public:
@@ -59,6 +65,19 @@ namespace sxako {
       finalized=true;
       return current_char_size;
     }
+    // set the initial value of the cell at "address" (see
+    // "Addressing<...>::address()")
+    template <typename CellT>
+    void set_initial(index_t address, CellT const &value) {
+      assert(address+sizeof(CellT)<=current_char_size);
+      initial.resize(current_char_size);
+      memcpy(initial.data()+address, &value, sizeof(CellT));
+    }
+    // initialise the storage of a "Data<kind>"
+    void initialize(char *data) const {
+      memset(data, 0, current_char_size);
+      memcpy(data, initial.data(), initial.size());
+    }
   private:
     // a data item addressing gives "get_offset()" its own size, and gets the
     // offset into the data repository
@@ -75,6 +94,7 @@ namespace sxako {
     friend class Addressing;
     mutable bool finalized=false;
     index_t current_char_size=0;
+    std::vector<char> initial; // empty if all zeros
   };
 
   // "Addressing<kind, Indexing, cell_t>" is a wrapping around "Indexing", that
@@ -104,6 +124,7 @@ namespace sxako {
       assert(relative_cell_index(c)<char_storage);
       return rel_to_abs(relative_cell_index(c));
     }
+    index_t address_of_index(index_t rel) const { return rel_to_abs(rel); }
   private:
     index_t rel_to_abs(index_t rel) const { return offset+rel*sizeof(cell_t); }
     index_t const char_storage;
@@ -123,6 +144,11 @@ namespace sxako {
     index_t relative_cell_index(coord_t) const { return 0; }
   };
 
+  namespace Impl {
+    template <typename>
+    class DataViews;
+  }
+
   // "bool_cell<cell_t>" is used to check if a cell is contained in an
   // addressing, and if so, get its contents, in one go; it is implicitly
   // convertible to bool, so it can be used like this:
@@ -153,11 +179,15 @@ namespace sxako {
   // "bool_cell<cell_t>" above), or "d(a).get_if_contains(c, cell)"; naturally,
   // the cell info is not returned or set if the index is not contained;
   // finally, if the data item addressing is in the form of a pointer, you can
-  // still use "d(a)"
+  // still use "d(a)"; a "Data<kind>" usually owns its storage, except when it
+  // is part of a "DataStore<...>" (see below), which owns the storage for all
+  // of its data repositories
   template <Kind kind>
   class Data {
     template <typename DataContents, typename AddrT>
     friend class Access;
+    template <typename>
+    friend class Impl::DataViews;
   public:
     // intermediate object to support the syntax "data(addr)[coord]":
     template <typename DataContents, typename AddrT>
@@ -177,6 +207,10 @@ namespace sxako {
         { return data.at(addr, c); }
       bool contains(coord_t const &c) const
         { return addr.contains(c); } // "data" not used, but parallels "[]"
+      // the cell at relative cell index "i" (see "Indexing"), which must be
+      // within the storage of the data item; no containedness check is made
+      auto const &at_index(index_t i) const
+        { return data.at_index(addr, i); }
       bool_cell<cell_t> get_if_contains(coord_t const &c) const {
         // turns out "relative_cell_index()" is so fast it doesn't pay off to
         // avoid calling it twice (from "contains()" and from "operator[]()"
@@ -196,18 +230,24 @@ namespace sxako {
     };
 
     Data(DataSpec<kind> const &ds)
-      : size(ds.char_size()), data(new char[size]()) { }
+      : size(ds.char_size()), data(new char[size]) { ds.initialize(data); }
     Data(Data<kind> const &d)
       : size(d.size), data(new char[size]) { memcpy(data, d.data, size); }
-    ~Data() { delete[] data; }
+    ~Data() {
+      if (owner)
+        delete[] data;
+    }
     Data &operator=(Data<kind> const &d) {
       assert(size==d.size);
       memcpy(data, d.data, size);
       return *this;
     }
 
-    // a dump of the raw contents of the data repository
+    // a dump of the raw contents of the data repository; "id_view()" and
+    // "id_hash()" don't copy them
     std::string id() const { return std::string(data, size); }
+    std::string_view id_view() const { return {data, size}; }
+    u64 id_hash() const { return hash_bytes(data, size); }
 
     // for a single var ("SingleVar"), return the cell directly...:
     template <Kind k, typename cell_t>
@@ -234,20 +274,33 @@ namespace sxako {
     decltype(auto) operator()(Ptr const &p) { return operator()(*p); }
 
   private:
+    // a view of the same size as "d" on storage owned by someone else
+    Data(Data<kind> const &d, char *data)
+      : size(d.size), data(data), owner(false) { }
+    Data(DataSpec<kind> const &ds, char *data)
+      : size(ds.char_size()), data(data), owner(false)
+      { ds.initialize(data); }
     template <typename Indexing, typename CellT, typename C>
     CellT const &at(Addressing<kind, Indexing, CellT> const &a, C c) const
       { return reinterpret_cast<CellT const &>(data[a.address(c)]); }
     template <typename Indexing, typename CellT, typename C>
     CellT &at(Addressing<kind, Indexing, CellT> const &a, C c)
       { return variable(constant(*this).at(a, c)); }
+    template <typename Indexing, typename CellT>
+    CellT const &at_index(Addressing<kind, Indexing, CellT> const &a,
+                          index_t i) const {
+      assert(i<a.cell_storage);
+      return reinterpret_cast<CellT const &>(data[a.address_of_index(i)]);
+    }
     index_t const size;
     char *const data;
+    bool const owner=true;
   };
 
-  // compare by comparing the dumps of their raw contents
+  // compare by comparing their raw contents
   template <Kind kind>
   bool operator==(Data<kind> const &a, Data<kind> const &b)
-    { return a.id()==b.id(); }
+    { return a.id_view()==b.id_view(); }
 
   // "DataStore<...>" is syntactic sugar for a group of data repositories for a
   // list of "Kind" values (one repository per kind); the matching group of
@@ -256,6 +309,12 @@ namespace sxako {
   // "DataStore<...>" is templatised no "DataStoreSpec<...>"; for a
   // "DataStore<...> ds", its "Data<k>" is selected by "ds.data<k>()"; see
   // "board" for an example of usage
+  //
+  // the data repositories of a "DataStore<...>" live one after another in a
+  // single, cache-line-aligned block, sized after the spec (so that a board
+  // takes no more than its game needs); the blocks are recycled, so that
+  // creating or copying a "DataStore<...>" seldom allocates once the game is
+  // going; copying it is a single "memcpy()"
 
   template <Kind...>
   struct DataStoreSpec { };
@@ -268,38 +327,139 @@ namespace sxako {
     DataStoreSpec<rk...> rds;
   };
 
-  template <typename>
-  class DataStore;
+  namespace Impl {
 
-  template <>
-  class DataStore<DataStoreSpec<>> {
-  public:
-    DataStore(DataStoreSpec<> const &) { }
-  };
+    // the size taken by a data repository in a block, so that the next one
+    // is aligned for any cell type
+    inline index_t block_size(index_t size) {
+      index_t const a=alignof(std::max_align_t);
+      return (size+a-1)/a*a;
+    }
 
-  template <Kind fk, Kind... rk> // "f": first; "r": rest
-  class DataStore<DataStoreSpec<fk, rk...>>
-    : public DataStore<DataStoreSpec<rk...>> {
-    using parent=DataStore<DataStoreSpec<rk...>>;
+    // the views of the data repositories of a "DataStore<...>" on its block
+    template <>
+    class DataViews<DataStoreSpec<>> {
+    public:
+      DataViews(DataStoreSpec<> const &, char *) { }
+      DataViews(DataViews const &, char *) { }
+      static index_t char_size(DataStoreSpec<> const &) { return 0; }
+    };
+
+    template <Kind fk, Kind... rk> // "f": first; "r": rest
+    class DataViews<DataStoreSpec<fk, rk...>>
+      : public DataViews<DataStoreSpec<rk...>> {
+      using parent=DataViews<DataStoreSpec<rk...>>;
+    public:
+      DataViews(DataStoreSpec<fk, rk...> const &dss, char *block)
+        : parent(dss.rds, block+block_size(dss.fds.char_size())),
+          fd(dss.fds, block) { }
+      DataViews(DataViews const &dv, char *block)
+        : parent(dv, block+block_size(dv.fd.size)), fd(dv.fd, block) { }
+      static index_t char_size(DataStoreSpec<fk, rk...> const &dss) {
+        return block_size(dss.fds.char_size())+parent::char_size(dss.rds);
+      }
+
+      // match: return this data
+      template <Kind k>
+      std::enable_if_t<k==fk, Data<k> &> data() { return fd; }
+      template <Kind k>
+      std::enable_if_t<k==fk, Data<k> const &> data() const { return fd; }
+
+      // no match: relay to parent
+      template <Kind k>
+      std::enable_if_t<k not_eq fk, Data<k> &> data()
+        { return parent::template data<k>(); }
+      template <Kind k>
+      std::enable_if_t<k not_eq fk, Data<k> const &> data() const
+        { return parent::template data<k>(); }
+    private:
+      Data<fk> fd;
+    };
+
+    // cache-line-aligned blocks of storage, by number of cache lines; a
+    // freed block is kept by the thread freeing it, for its next block of the
+    // same number of lines (the blocks kept are freed when the thread ends)
+    class BlockPool {
+    public:
+      static constexpr index_t cache_line=64;
+      static char *get(index_t size) {
+        index_t const n_lines=lines(size);
+        if (not closed) {
+          auto &kept=free_blocks(n_lines);
+          if (not kept.empty()) {
+            char *block=kept.back();
+            kept.pop_back();
+            return block;
+          }
+        }
+        return
+          static_cast<char *>(operator new[](n_lines*cache_line,
+                                             std::align_val_t(cache_line)));
+      }
+      static void put(char *block, index_t size) {
+        if (closed)
+          operator delete[](block, std::align_val_t(cache_line));
+        else
+          free_blocks(lines(size)).push_back(block);
+      }
+    private:
+      static index_t lines(index_t size)
+        { return std::max((size+cache_line-1)/cache_line, index_t(1)); }
+      struct FreeBlocks {
+        ~FreeBlocks() {
+          closed=true; // for the blocks freed later on (e.g., by statics)
+          for (auto &kept: by_lines)
+            for (char *block: kept)
+              operator delete[](block, std::align_val_t(cache_line));
+        }
+        std::vector<std::vector<char *>> by_lines;
+      };
+      static std::vector<char *> &free_blocks(index_t n_lines) {
+        thread_local FreeBlocks pool;
+        if (n_lines>=pool.by_lines.size())
+          pool.by_lines.resize(n_lines+1);
+        return pool.by_lines[n_lines];
+      }
+      static inline thread_local bool closed=false;
+    };
+
+    // a zero-initialised, cache-line-aligned block of storage, from the pool
+    class DataBlock {
+    public:
+      DataBlock(index_t size)
+        : size(size), block(BlockPool::get(size))
+        { memset(block, 0, size); }
+      DataBlock(DataBlock const &db)
+        : size(db.size), block(BlockPool::get(size))
+        { memcpy(block, db.block, size); }
+      ~DataBlock()
+        { BlockPool::put(block, size); }
+      DataBlock &operator=(DataBlock const &db) {
+        assert(size==db.size);
+        memcpy(block, db.block, size);
+        return *this;
+      }
+      index_t const size;
+    protected:
+      char *const block;
+    };
+
+  }
+
+  template <typename DSS>
+  class DataStore
+    : private Impl::DataBlock, public Impl::DataViews<DSS> {
+    using block_t=Impl::DataBlock;
+    using views_t=Impl::DataViews<DSS>;
   public:
-    DataStore(DataStoreSpec<fk, rk...> const &dss)
-      : parent(dss.rds), fd(dss.fds) { }
-
-    // match: return this data
-    template <Kind k>
-    std::enable_if_t<k==fk, Data<k> &> data() { return fd; }
-    template <Kind k>
-    std::enable_if_t<k==fk, Data<k> const &> data() const { return fd; }
-
-    // no match: relay to parent
-    template <Kind k>
-    std::enable_if_t<k not_eq fk, Data<k> &> data()
-      { return parent::template data<k>(); }
-    template <Kind k>
-    std::enable_if_t<k not_eq fk, Data<k> const &> data() const
-      { return parent::template data<k>(); }
-  private:
-    Data<fk> fd;
+    DataStore(DSS const &dss)
+      : block_t(views_t::char_size(dss)), views_t(dss, this->block) { }
+    DataStore(DataStore const &ds)
+      : block_t(ds), views_t(ds, this->block) { }
+    DataStore &operator=(DataStore const &ds) {
+      block_t::operator=(ds);
+      return *this;
+    }
   };
 
   /// board containedness functions and their algebra
@@ -0,0 +1,656 @@
+#include "monte_carlo.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+namespace sxako {
+
+  MonteCarloTree::MonteCarloTree(Board const &root_board,
+                                 PositionPath const &root_path,
+                                 size_t max_nodes)
+    : root_b(root_board), root_p(root_path),
+      nodes(max_nodes), moves(max_nodes)
+    { nodes.add(none); }
+
+  MonteCarloTree::MonteCarloTree(MonteCarloTree const &tree,
+                                 index_t subtree_root,
+                                 Board const &root_board,
+                                 PositionPath const &root_path)
+    : MonteCarloTree(root_board, root_path, tree.capacity()) {
+    // copy breadth-first
+    vector<index_t> copies(tree.size(), none); // new index, by old index
+    deque<pair<index_t, index_t>> pending={{subtree_root, root}};
+    while (not pending.empty()) {
+      auto [from, to]=pending.front();
+      pending.pop_front();
+      copies[from]=to;
+      auto const &f=tree[from];
+      auto &t=nodes[to];
+      t.total_score=f.total_score.load();
+      t.n_simulations=f.n_simulations.load();
+      t.transposition=f.transposition.load(); // old index, for now
+      t.proven=f.proven.load();
+      t.amaf_total_score=f.amaf_total_score.load();
+      t.amaf_n_simulations=f.amaf_n_simulations.load();
+      t.first_move=index_t(moves.size());
+      for (auto m=f.first_move; m<f.first_move+f.n_moves; ++m)
+        moves.add(tree.moves[m]);
+      t.n_moves=f.n_moves.load(); // "unexpandable" isn't: there's room again
+      for (auto c=f.first_child.load(); c not_eq none;
+           c=tree[c].next_sibling) {
+        auto copy=nodes.add(t.first_move+(tree[c].move-f.first_move));
+        (t.last_child==none ? t.first_child : nodes[t.last_child].next_sibling)
+          =copy;
+        t.last_child=copy;
+        pending.push_back({c, copy});
+      }
+      t.n_children=f.n_children.load();
+    }
+    // transpositions whose canonical node hasn't been copied are forgotten,
+    // and will be looked for again on their next visit
+    for (index_t i=0; i<nodes.size(); ++i)
+      if (nodes[i].transposition not_eq none) {
+        nodes[i].transposition=copies[nodes[i].transposition];
+        if (nodes[i].transposition==none) {
+          nodes[i].total_score=0.;
+          nodes[i].n_simulations=0;
+        }
+      }
+    for (auto const &kc: tree.positions)
+      if (copies[kc.second] not_eq none)
+        positions[kc.first]=copies[kc.second];
+  }
+
+  MonteCarloTree::index_t MonteCarloTree::transpose(index_t i, size_t key) {
+    lock_guard<mutex> lock(expansion);
+    auto canonical=positions.insert({key, i}).first->second;
+    if (canonical not_eq i)
+      nodes[i].transposition=canonical;
+    return canonical;
+  }
+
+  MonteCarloTree::index_t MonteCarloTree::find(Game const &g,
+                                               unsigned max_depth) const {
+    // the game must have gone through the root, and then "depth" more
+    // positions, which are followed down the tree
+    auto const &path=g.path();
+    if (path.size()<root_p.size() or path.size()>root_p.size()+max_depth
+        or not equal(root_p.begin(), root_p.end(), path.begin()))
+      return none;
+    auto const depth=path.size()-root_p.size();
+    auto const id=g.board().id_view();
+    function<index_t (index_t, Board const &, size_t)> search=
+      [&](index_t i, Board const &b_i, size_t d) {
+        i=resolve(i);
+        if (d==depth)
+          return b_i.id_view()==id ? i : none;
+        for (auto c=nodes[i].first_child.load(); c not_eq none;
+             c=nodes[c].next_sibling) {
+          Board b_c=b_i;
+          g.move(b_c, move(c));
+          if (b_c.id_hash()==path[root_p.size()+d]) {
+            auto found=search(c, b_c, d+1);
+            if (found not_eq none)
+              return found;
+          }
+        }
+        return none;
+      };
+    return search(root, root_b, 0);
+  }
+
+  bool MonteCarloTree::expand(index_t parent, vector<Move> const &moves) {
+    lock_guard<mutex> lock(expansion);
+    auto &p=nodes[parent];
+    if (p.n_moves)
+      return false;
+    if (not this->moves.fits(moves.size())) {
+      p.unexpandable=true;
+      return false;
+    }
+    p.first_move=index_t(this->moves.size());
+    for (auto const &m: moves)
+      this->moves.add(m);
+    p.n_moves=index_t(moves.size()); // publish the moves
+    return true;
+  }
+
+  MonteCarloTree::index_t MonteCarloTree::add_child(index_t parent) {
+    lock_guard<mutex> lock(expansion);
+    auto &p=nodes[parent];
+    if (p.n_children==p.n_moves or not nodes.fits(1))
+      return none;
+    auto child=nodes.add(p.first_move+p.n_children);
+    ++p.n_children;
+    // publish the child
+    (p.last_child==none ? p.first_child : nodes[p.last_child].next_sibling)
+      =child;
+    p.last_child=child;
+    return child;
+  }
+
+  namespace {
+
+    using random_number_t=Rules::random_index_f;
+    using node_index_t=MonteCarloTree::index_t;
+
+    // atomic addition for floating point ("fetch_add()" only handles integers
+    // before C++20)
+    void atomic_add(atomic<score_t> &a, score_t s) {
+      auto old=a.load(memory_order_relaxed);
+      while (not a.compare_exchange_weak(old, old+s, memory_order_relaxed)) { }
+    }
+
+    // play random moves from "b" until the game ends, or until the playout
+    // length (if any) is reached, where the evaluation function is squashed
+    // into [-1, 1]; the score is from the point of view of the player who
+    // played into "b"; the moves are added to "played", if given, and the
+    // positions to "path" (which holds those that led to "b")
+    score_t play_random_to_the_end(Game const &g, Board &b, PositionPath &path,
+                                   evaluation_function_t const &eval,
+                                   AlgorithmParams::monte_carlo_t const &p,
+                                   random_number_t const &random_number,
+                                   size_t &moves_left,
+                                   vector<Move> *played) {
+      int factor=+1;
+      for (unsigned length=0; ; ++length) {
+        if (p.playout_length and length==p.playout_length) {
+          auto outcome=g.outcome(b, path);
+          return
+            factor
+            *(outcome==Rules::Outcome::playing
+              ? tanh(eval(b)/p.playout_scale)
+              : eval_outcome(outcome));
+        }
+        Move m;
+        auto outcome=
+          g.outcome_and_random_legal_move(b, m, random_number, path);
+        if (outcome not_eq Rules::Outcome::playing)
+          return factor*eval_outcome(outcome);
+
+        if (moves_left)
+          --moves_left;
+        if (played)
+          played->push_back(m);
+        g.move(b, m);
+        path.push_back(b.id_hash());
+        factor=-factor;
+      }
+    }
+
+    // the result of "select_child()": the child to go to, if any; otherwise,
+    // either every move of the node has a child, all of them proven, which
+    // proves the node too ("proven" is then its proof), or the node budget is
+    // exhausted ("proven" is then 0)
+    struct selection_t {
+      node_index_t child=MonteCarloTree::none;
+      s8 proven=0;
+    };
+
+    // UCT selection: unvisited children come first (in the order of the
+    // moves, adding a child if needed), and then the child with the highest
+    // UCB1 bound; with progressive widening, only the first moves are
+    // considered, more of them as the node gets more visits; proven children
+    // are skipped (there's nothing left to learn from them), so that the
+    // moves past the widening are considered if all the others are proven;
+    // with RAVE, a child's mean is blended with its all-moves-as-first mean,
+    // whose weight decays as the child gets more visits
+    selection_t select_child(MonteCarloTree &tree, node_index_t parent,
+                             AlgorithmParams::monte_carlo_t const &p) {
+      auto const &n=tree[parent];
+      score_t const log_n=log(score_t(n.n_simulations));
+      node_index_t best=MonteCarloTree::none;
+      score_t best_bound=numeric_limits<score_t>::lowest();
+      bool some_child_wins=false;
+      for (auto i=n.first_child.load(); i not_eq MonteCarloTree::none;
+           i=tree[i].next_sibling) {
+        auto const &c=tree[i];
+        if (c.proven) {
+          some_child_wins=some_child_wins or c.proven>0;
+          continue;
+        }
+        if (not c.n_simulations)
+          return {i};
+        // a transposition's score is its canonical node's
+        auto const &v=tree[tree.resolve(i)];
+        score_t mean=v.n_simulations ? v.mean() : c.mean();
+        if (p.rave>0. and c.amaf_n_simulations) {
+          score_t beta=
+            sqrt(p.rave/(score_t(3.)*score_t(c.n_simulations)+p.rave));
+          mean=(1-beta)*mean+beta*c.amaf_mean();
+        }
+        score_t bound=
+          mean+p.exploration*sqrt(log_n/score_t(c.n_simulations));
+        if (bound>best_bound) {
+          best_bound=bound;
+          best=i;
+        }
+      }
+      node_index_t n_considered=n.n_moves;
+      if (p.widening>0.)
+        n_considered=
+          node_index_t(
+            min(score_t(n_considered),
+                max(score_t(1.),
+                    ceil(p.widening
+                         *pow(score_t(n.n_simulations),
+                              p.widening_exponent)))));
+      if (n.n_children<n_considered
+          or (best==MonteCarloTree::none and n.n_children<n.n_moves)) {
+        auto child=tree.add_child(parent);
+        if (child not_eq MonteCarloTree::none)
+          return {child};
+      }
+      if (best==MonteCarloTree::none and n.n_children==n.n_moves)
+        return {MonteCarloTree::none, s8(some_child_wins ? -1 : +1)};
+      return {best};
+    }
+
+    // whether all the moves of node "i" have a child, proven to lose
+    bool all_children_lose(MonteCarloTree const &tree, node_index_t i) {
+      node_index_t n_losing=0;
+      for (auto c=tree[i].first_child.load(); c not_eq MonteCarloTree::none;
+           c=tree[c].next_sibling)
+        if (tree[c].proven<0)
+          ++n_losing;
+        else
+          return false;
+      return n_losing==tree[i].n_moves;
+    }
+
+    // all-moves-as-first update after a simulation that went down "path" and
+    // then played "played", with "score" from the point of view of the
+    // player who played into the last node of "path": each child of a node
+    // in "path" whose move was played later on by the same player (that of
+    // the ply from the node) gets the score for that player
+    void update_amaf(MonteCarloTree &tree, vector<node_index_t> const &path,
+                     vector<Move> const &played, score_t score) {
+      using signature_t=basic_string<Move::char_t>;
+      auto const n_path_plies=path.size()-1;
+      auto move_at=[&](size_t ply) -> Move const & {
+        return
+          ply<n_path_plies
+          ? tree.move(path[ply+1])
+          : played[ply-n_path_plies];
+      };
+      set<signature_t> later[2]; // moves from a ply on, by ply parity
+      for (auto ply=n_path_plies+played.size(); ply-->0; ) {
+        later[ply%2].insert(move_at(ply).as_string());
+        if (ply>=path.size())
+          continue;
+        // the leaf was played into on ply "n_path_plies-1"
+        score_t const ply_score=(n_path_plies-ply)%2 ? score : -score;
+        for (auto c=tree[tree.resolve(path[ply])].first_child.load();
+             c not_eq MonteCarloTree::none; c=tree[c].next_sibling)
+          if (later[ply%2].count(tree.move(c).as_string())) {
+            atomic_add(tree[c].amaf_total_score, ply_score);
+            ++tree[c].amaf_n_simulations;
+          }
+      }
+    }
+
+    // a virtual loss makes a node look as if it had lost one more simulation
+    // while a thread is simulating through it, so that the other threads
+    // prefer other paths; it's taken back on backpropagation
+    score_t const virtual_loss=-1.;
+
+    // run simulations on "tree" until the playout moves budget is spent or the
+    // deadline has passed; "shared" means other threads are running on the
+    // same tree
+    template <typename URGB>
+    void simulate(Game const &g, MonteCarloTree &tree,
+                  evaluation_function_t const &eval,
+                  AlgorithmParams const &p, URGB &random,
+                  size_t n_moves, Deadline const &deadline, bool shared) {
+      auto random_number=[&random](size_t n)
+        { return uniform_int_distribution<size_t>(0, n-1)(random); };
+      bool const graph=p.monte_carlo.graph;
+      // with a graph, a proof may depend on the path (e.g., by repetition)
+      bool const solver=p.monte_carlo.solver and not graph;
+      bool const rave=p.monte_carlo.rave>0.;
+      vector<Move> played; // for RAVE, the playout moves
+      auto const &root=tree[MonteCarloTree::root];
+      vector<node_index_t> path;
+      vector<node_index_t> positions; // for a graph, the canonical nodes
+      Board b=tree.root_board();
+      // the positions that led to "b", from the start of the game
+      PositionPath b_path=tree.root_path();
+      auto const root_path_size=b_path.size();
+      // add a node to the path, and play its move; return the node holding
+      // its children (for a graph, a node is looked for in the transpositions
+      // table on its first visit)
+      auto enter=[&](node_index_t i) {
+        bool first_visit=not tree[i].n_simulations;
+        path.push_back(i);
+        if (i not_eq MonteCarloTree::root) {
+          g.move(b, tree.move(i));
+          b_path.push_back(b.id_hash());
+        }
+        if (shared) {
+          ++tree[i].n_simulations;
+          atomic_add(tree[i].total_score, virtual_loss);
+        }
+        return
+          graph and first_visit
+          ? tree.transpose(i, b_path.back())
+          : tree.resolve(i);
+      };
+      size_t moves_left=n_moves;
+      // at least one simulation, so that there's a move to choose from
+      // (unless the root is already proven):
+      while (moves_left and not root.proven
+             and not (root.n_simulations and deadline.passed())) {
+        /// selection
+        // go down the expanded nodes, rebuilding the board on the way, and
+        // stop at the first unvisited node
+        b=tree.root_board();
+        b_path.resize(root_path_size);
+        path.clear();
+        positions.clear();
+        played.clear();
+        auto at=enter(MonteCarloTree::root);
+        bool visited=true;
+        auto outcome=Rules::Outcome::playing;
+        while (visited and tree[at].n_moves) {
+          if (graph) {
+            // a node's children may have been found on another path, on
+            // which the game hadn't finished (e.g., by repetition); and
+            // coming back to a position means going round in circles
+            if (path.size()>1
+                and (outcome=g.outcome(b, b_path))
+                    not_eq Rules::Outcome::playing)
+              break;
+            if (find(positions.begin(), positions.end(), at)
+                not_eq positions.end()) {
+              visited=false;
+              break;
+            }
+            positions.push_back(at);
+          }
+          auto selection=select_child(tree, at, p.monte_carlo);
+          if (selection.child==MonteCarloTree::none) {
+            // the node has just been proven (through its children, proven by
+            // other simulations), or the node budget is exhausted
+            tree[at].proven=selection.proven;
+            visited=false;
+            break;
+          }
+          visited=tree[selection.child].n_simulations;
+          at=enter(selection.child);
+        }
+        /// expansion
+        // a node is expanded on its second visit (the root, on its first one),
+        // unless the node budget is exhausted, or its moves didn't fit before
+        score_t score;
+        if (visited and outcome==Rules::Outcome::playing
+            and not tree[at].unexpandable) {
+          Moves all_moves;
+          outcome=g.outcome_and_legal_moves(b, all_moves, b_path);
+          if (outcome==Rules::Outcome::playing) {
+            vector<Move> // a list can't be shuffled: random access
+              all_moves_shuffled(all_moves.begin(), all_moves.end());
+            shuffle(all_moves_shuffled.begin(), all_moves_shuffled.end(),
+                    random);
+            if (tree.expand(at, all_moves_shuffled)) {
+              auto child=tree.add_child(at);
+              if (child not_eq MonteCarloTree::none)
+                enter(child);
+            }
+          }
+        }
+        auto moves_left_before=moves_left;
+        if (outcome not_eq Rules::Outcome::playing) {
+          score=eval_outcome(outcome);
+          if (solver and outcome not_eq Rules::Outcome::draw)
+            tree[path.back()].proven=score>0. ? +1 : -1;
+        }
+        else if (tree[path.back()].proven) // no need for a simulation
+          score=tree[path.back()].proven;
+        else /// simulation
+          score=play_random_to_the_end(g, b, b_path, eval, p.monte_carlo,
+                                       random_number, moves_left,
+                                       rave ? &played : nullptr);
+        // a simulation counts for at least one move, so that simulations
+        // reaching the end of the game within the tree don't go on forever
+        if (moves_left==moves_left_before and moves_left)
+          --moves_left;
+        /// backpropagation
+        if (rave)
+          update_amaf(tree, path, played, score);
+        for (auto i=path.rbegin(); i not_eq path.rend(); ++i) {
+          if (shared) // the visit has already been counted
+            atomic_add(tree[*i].total_score, score-virtual_loss);
+          else {
+            atomic_add(tree[*i].total_score, score);
+            ++tree[*i].n_simulations;
+          }
+          auto canonical=tree[*i].transposition.load();
+          if (canonical not_eq MonteCarloTree::none) {
+            atomic_add(tree[canonical].total_score, score);
+            ++tree[canonical].n_simulations;
+          }
+          score=-score;
+        }
+        /// proof propagation
+        for (auto k=path.size()-1; solver and k>0 and tree[path[k]].proven;
+             --k) {
+          auto &parent=tree[path[k-1]];
+          if (tree[path[k]].proven>0)
+            parent.proven=-1;
+          else if (all_children_lose(tree, path[k-1]))
+            parent.proven=+1;
+        }
+      }
+    }
+
+    // the statistics of a root child, added up over the trees
+    struct root_stats_t {
+      score_t total_score=0.;
+      u32 n_simulations=0;
+      s8 proven=0;
+      score_t mean() const { return total_score/score_t(n_simulations); }
+    };
+
+    // the most visited line below node "i", up to "max_length" moves
+    Moves most_visited_line(MonteCarloTree const &tree, node_index_t i,
+                            size_t max_length) {
+      Moves line;
+      while (line.size()<max_length) {
+        node_index_t best=MonteCarloTree::none;
+        u32 best_n_simulations=0;
+        for (auto c=tree[tree.resolve(i)].first_child.load();
+             c not_eq MonteCarloTree::none; c=tree[c].next_sibling)
+          if (tree[c].n_simulations>best_n_simulations) {
+            best=c;
+            best_n_simulations=tree[c].n_simulations;
+          }
+        if (best==MonteCarloTree::none)
+          break;
+        line.push_back(tree.move(best));
+        i=best;
+      }
+      return line;
+    }
+
+    size_t const max_pv_length=16;
+
+    // a report of the search, of bounded size: the number of simulations and
+    // their rate, the most visited root children (with their mean score and
+    // its 95% confidence half-width), and the number of nodes by depth
+    string search_report(
+      Game const &g, MonteCarloTree const &tree,
+      vector<pair<node_index_t, root_stats_t>> children,
+      u32 n_simulations, seconds_t seconds) {
+      size_t const max_children=5, max_depths=12;
+      auto rounded=[](score_t s) { return round(s*1000.f)/1000.f; };
+      string report=
+        "  monte carlo: "+to_text(n_simulations)+" simulations ("
+        +to_text(round(seconds>0. ? n_simulations/seconds : 0.))+"/s)\n";
+      sort(children.begin(), children.end(),
+           [](auto const &a, auto const &b)
+             { return a.second.n_simulations>b.second.n_simulations; });
+      for (size_t k=0; k<children.size(); ++k) {
+        if (k==max_children) {
+          report+="    ("+to_text(children.size()-k)+" more moves)\n";
+          break;
+        }
+        auto const &[i, stats]=children[k];
+        report+="    "+g.write_move(tree.move(i))+": "
+                +to_text(stats.n_simulations)+" visits, ";
+        if (stats.proven)
+          report+=stats.proven>0 ? "won\n" : "lost\n";
+        else if (stats.n_simulations) {
+          // the variance of a score in [-1, 1] with mean "m" is at most
+          // "1-m^2"
+          score_t mean=stats.mean();
+          score_t half_width=
+            1.96f*sqrt(max(score_t(0.), 1-mean*mean)
+                       /score_t(stats.n_simulations));
+          report+="mean "+to_text(rounded(mean))
+                  +" +- "+to_text(rounded(half_width))+"\n";
+        }
+        else
+          report+="unvisited\n";
+      }
+      // nodes by depth, breadth-first (transpositions have no children of
+      // their own)
+      vector<size_t> by_depth;
+      vector<node_index_t> level={MonteCarloTree::root}, next_level;
+      while (not level.empty()) {
+        by_depth.push_back(level.size());
+        next_level.clear();
+        for (auto i: level)
+          for (auto c=tree[i].first_child.load();
+               c not_eq MonteCarloTree::none; c=tree[c].next_sibling)
+            next_level.push_back(c);
+        swap(level, next_level);
+      }
+      report+="    "+to_text(tree.size())+" nodes, by depth:";
+      for (size_t d=0; d<by_depth.size(); ++d) {
+        if (d==max_depths) {
+          report+=" ("+to_text(by_depth.size()-d)+" more depths)";
+          break;
+        }
+        report+=" "+to_text(by_depth[d]);
+      }
+      return report+"\n";
+    }
+
+  }
+
+  MoveScore monte_carlo_best_move(Game const &g, MonteCarloTree &tree,
+                                  evaluation_function_t const &eval,
+                                  AlgorithmParams const &p,
+                                  random_generator_t &random,
+                                  size_t n_moves, Deadline const &deadline) {
+    using parallel_t=AlgorithmParams::monte_carlo_t::parallel_t;
+    unsigned const n_threads=p.monte_carlo.threads;
+    bool const root_parallel=p.monte_carlo.parallel==parallel_t::root;
+    Deadline const started; // never reached; for the simulation rate
+    u32 const n_previous_simulations=tree[MonteCarloTree::root].n_simulations;
+
+    // the trees for the other threads, with root parallelisation
+    vector<unique_ptr<MonteCarloTree>> other_trees;
+    if (root_parallel)
+      for (auto t: loop(1u, n_threads))
+        other_trees.push_back(
+          make_unique<MonteCarloTree>(tree.root_board(), tree.root_path(),
+                                      tree.capacity()));
+
+    if (n_threads==1)
+      simulate(g, tree, eval, p, random, n_moves, deadline, false);
+    else {
+      // each thread gets its own random generator, and its share of the
+      // playout moves budget
+      vector<random_generator_t> randoms;
+      for (auto t: loop(n_threads))
+        randoms.emplace_back(random());
+      size_t const thread_n_moves=max(n_moves/n_threads, size_t(1));
+      vector<thread> threads;
+      for (unsigned t=0; t<n_threads; ++t)
+        threads.emplace_back(
+          [&, t] {
+            if (root_parallel)
+              simulate(g, t ? *other_trees[t-1] : tree, eval, p, randoms[t],
+                       thread_n_moves, deadline, false);
+            else
+              simulate(g, tree, eval, p, randoms[t],
+                       thread_n_moves, deadline, true);
+          });
+      for (auto &t: threads)
+        t.join();
+    }
+
+    // root statistics, added up over the trees, by child of the root of
+    // "tree" (the roots of the other trees have the same children, but maybe
+    // in a different order)
+    u32 n_simulations=
+      tree[MonteCarloTree::root].n_simulations-n_previous_simulations;
+    map<basic_string<Move::char_t>, root_stats_t> other_stats;
+    for (auto const &other: other_trees) {
+      n_simulations+=(*other)[MonteCarloTree::root].n_simulations;
+      for (auto i=(*other)[MonteCarloTree::root].first_child.load();
+           i not_eq MonteCarloTree::none; i=(*other)[i].next_sibling) {
+        auto &stats=other_stats[other->move(i).as_string()];
+        stats.total_score+=(*other)[i].total_score;
+        stats.n_simulations+=(*other)[i].n_simulations;
+        if ((*other)[i].proven)
+          stats.proven=(*other)[i].proven;
+      }
+    }
+    vector<pair<node_index_t, root_stats_t>> children;
+    for (auto i=tree[MonteCarloTree::root].first_child.load();
+         i not_eq MonteCarloTree::none; i=tree[i].next_sibling) {
+      root_stats_t stats{tree[i].total_score, tree[i].n_simulations,
+                         tree[i].proven};
+      auto other=other_stats.find(tree.move(i).as_string());
+      if (other not_eq other_stats.end()) {
+        stats.total_score+=other->second.total_score;
+        stats.n_simulations+=other->second.n_simulations;
+        if (not stats.proven)
+          stats.proven=other->second.proven;
+      }
+      children.push_back({i, stats});
+    }
+
+    // best move: one proven to win, if any; otherwise, the most visited one
+    // (the one UCT trusts the most), preferably not proven to lose
+    MoveScore best{Move(), 0.};
+    node_index_t best_i=MonteCarloTree::none;
+    u32 best_n_simulations=0;
+    bool best_loses=true;
+    for (auto const &[i, stats]: children) {
+      if (stats.proven>0) {
+        best={tree.move(i), +1.};
+        best_i=i;
+        break;
+      }
+      bool const loses=stats.proven<0;
+      if (stats.n_simulations
+          and ((best_loses and not loses)
+               or (loses==best_loses
+                   and stats.n_simulations>best_n_simulations))) {
+        best={tree.move(i), loses ? score_t(-1.) : stats.mean()};
+        best_i=i;
+        best_n_simulations=stats.n_simulations;
+        best_loses=loses;
+      }
+    }
+    if (best_i not_eq MonteCarloTree::none) {
+      best.pv=most_visited_line(tree, best_i, max_pv_length-1);
+      best.pv.push_front(best.move);
+    }
+    best.report=search_report(g, tree, children, n_simulations,
+                              started.elapsed());
+
+    return best;
+  }
+
+}
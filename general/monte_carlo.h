@@ -0,0 +1,172 @@
+#ifndef SXAKO_MONTE_CARLO_HEADER_
+#define SXAKO_MONTE_CARLO_HEADER_
+
+#include "think.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sxako {
+
+  // the tree for the Monte Carlo tree search; its nodes live in an arena with
+  // a fixed capacity (the node budget), and refer to each other by index; a
+  // node keeps only its move and its statistics: its board is rebuilt by
+  // replaying the moves from the root
+  //
+  // expansion is lazy: expanding a node stores its moves in a pool (with the
+  // same capacity as the node arena), and its children are only created, one
+  // by one, in the order of the moves, when the search first goes there; a
+  // node whose moves no longer fit in the pool is marked as unexpandable, so
+  // that they aren't generated again on its later visits
+  //
+  // the tree can be shared by several threads: the statistics are atomic, and
+  // nodes are expanded, and children added, under a lock, and published by
+  // "n_moves" and "next_sibling" once complete
+  //
+  // the tree can also be turned into a graph, by merging the nodes for the
+  // same position: the first node to reach a position (its canonical node) is
+  // registered in a table keyed by the position hash; the other nodes for the
+  // position become transpositions of it: they keep their own number of
+  // simulations (that of the edge from their parent), but they share the
+  // canonical node's score and children
+  //
+  // with the solver, a node whose move ends the game is proven to win or to
+  // lose; a node with a child proven to win is proven to lose, and a node
+  // whose children (for all of its moves) are proven to lose is proven to win
+  class MonteCarloTree {
+  public:
+    using index_t=u32;
+    static index_t const root=0, none=~index_t(0);
+    struct node_t {
+      node_t(index_t move) : move(move) { }
+      index_t const move; // the move leading to this node, in the pool
+      // total score, from the point of view of the player who played "move"
+      std::atomic<score_t> total_score{0.};
+      std::atomic<u32> n_simulations{0};
+      // the moves from this node, in the pool; "n_moves==0" means the node
+      // hasn't been expanded (yet)
+      index_t first_move=0;
+      std::atomic<index_t> n_moves{0};
+      // whether the moves didn't fit in the pool (for this tree)
+      std::atomic<bool> unexpandable{false};
+      // the children, as a list, in the order of the moves
+      std::atomic<index_t> first_child{none}, next_sibling{none};
+      index_t last_child=none;
+      std::atomic<index_t> n_children{0};
+      // the canonical node, for a transposition; "none" otherwise
+      std::atomic<index_t> transposition{none};
+      // for the solver, whether "move" is proven to win (+1) or to lose (-1),
+      // or not proven (0)
+      std::atomic<s8> proven{0};
+      score_t mean() const { return total_score/score_t(n_simulations); }
+      // for RAVE, the all-moves-as-first statistics: those of the
+      // simulations through the parent in which "move" was played by the same
+      // player, at any later point
+      std::atomic<score_t> amaf_total_score{0.};
+      std::atomic<u32> amaf_n_simulations{0};
+      score_t amaf_mean() const
+        { return amaf_total_score/score_t(amaf_n_simulations); }
+    };
+
+    // "root_path" holds the positions that led to "root_board", the latter
+    // included (see "PositionPath")
+    MonteCarloTree(Board const &root_board, PositionPath const &root_path,
+                   size_t max_nodes);
+    // a new tree (with the same node budget) holding a copy of the subtree of
+    // "tree" below node "subtree_root", whose board is "root_board", reached
+    // through "root_path"; the statistics are kept
+    MonteCarloTree(MonteCarloTree const &tree, index_t subtree_root,
+                   Board const &root_board, PositionPath const &root_path);
+
+    Board const &root_board() const { return root_b; }
+    PositionPath const &root_path() const { return root_p; }
+    node_t &operator[](index_t i) { return nodes[i]; }
+    node_t const &operator[](index_t i) const { return nodes[i]; }
+    Move const &move(index_t i) const { return moves[nodes[i].move]; }
+    size_t size() const { return nodes.size(); }
+    size_t capacity() const { return nodes.capacity; }
+
+    // the node holding the score and the children for node "i": its
+    // canonical node if it's a transposition, "i" itself otherwise
+    index_t resolve(index_t i) const {
+      index_t t=nodes[i].transposition;
+      return t==none ? i : t;
+    }
+    // register node "i" as the canonical node for the position with hash
+    // "key", unless there's already one, which "i" then becomes a
+    // transposition of; return the canonical node
+    index_t transpose(index_t i, size_t key);
+
+    // the (canonical) node for the current board of "g", if any, searching
+    // (and replaying the moves) down to "max_depth" moves below the root;
+    // "none" otherwise; the node must have been reached through the same
+    // positions as the game, since its statistics depend on them (e.g., by
+    // repetition)
+    index_t find(Game const &g, unsigned max_depth) const;
+
+    // store the moves for "parent", in that order; if that would exceed the
+    // capacity of the pool (then "parent" is marked as unexpandable), or if
+    // "parent" has already been expanded (possibly by another thread),
+    // nothing is stored, and "false" is returned
+    bool expand(index_t parent, std::vector<Move> const &moves);
+    // add a child to "parent", for its first move without one; return the
+    // child, or "none" if there are no moves left or the node budget is
+    // exhausted
+    index_t add_child(index_t parent);
+  private:
+    // raw storage for a fixed number of "T"s, constructed one after another;
+    // they never move
+    template <typename T>
+    class Arena {
+    public:
+      Arena(size_t capacity)
+        : capacity(capacity),
+          items(capacity<1 or capacity>~index_t(0)
+                ? throw std::invalid_argument("wrong Monte Carlo node budget")
+                : static_cast<T *>(operator new(capacity*sizeof(T)))) { }
+      Arena(Arena const &)=delete;
+      Arena &operator=(Arena const &)=delete;
+      ~Arena() {
+        for (size_t i=0; i<n; ++i)
+          items[i].~T();
+        operator delete(items);
+      }
+      size_t const capacity;
+      T &operator[](index_t i) { return items[i]; }
+      T const &operator[](index_t i) const { return items[i]; }
+      size_t size() const { return n; }
+      bool fits(size_t more) const { return n+more<=capacity; }
+      template <typename... Args>
+      index_t add(Args &&... args) {
+        new (&items[n]) T(std::forward<Args>(args)...);
+        return index_t(n++);
+      }
+    private:
+      T *const items;
+      size_t n=0;
+    };
+
+    Board const root_b;
+    PositionPath const root_p;
+    Arena<node_t> nodes;
+    Arena<Move> moves;
+    std::mutex expansion; // for the arenas and "positions"
+    std::unordered_map<size_t, index_t> positions; // canonical nodes, by key
+  };
+
+  // run simulations on "tree" until "n_moves" playout moves have been made or
+  // the deadline has passed (but at least one), and return the most visited
+  // move at the root, with its mean score; with several threads (see
+  // "AlgorithmParams::monte_carlo_t"), they either share "tree", or grow a
+  // tree each (the first of them being "tree") whose root statistics are added
+  // up
+  MoveScore monte_carlo_best_move(Game const &g, MonteCarloTree &tree,
+                                  evaluation_function_t const &eval,
+                                  AlgorithmParams const &p,
+                                  random_generator_t &random,
+                                  size_t n_moves, Deadline const &deadline);
+
+}
+
+#endif
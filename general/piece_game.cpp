@@ -1,6 +1,9 @@
 #include "piece_game.h"
 #include "display_svg.h"
 #include <regex>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -32,17 +35,18 @@ namespace sxako::piece_2d_game {
                          add_legal_move_f const &add_legal_move,
                          bool only_capture, Location to_capture,
                          std::function<bool ()> const &stop) const {
-    for (auto l: (c==Color::white
-                  ? d.squares.all_enumerated_coords
-                  : d.squares.reverse_all_enumerated_coords)) {
-      Square s=b(d.squares)[l];
-      if (d.is_occupied(s) and d.color_of(s)==c)
-        for (auto f: square_legal_moves_filters[s]) {
+    // black goes through the board in reverse
+    d.piece_squares.for_each(
+      b, c, c==Color::black,
+      [&](Location l) {
+        Square s=b(d.squares)[l];
+        for (auto const &f: square_legal_moves_filters[s]) {
           f(add_legal_move, b, l, s, only_capture, to_capture);
           if (stop())
-            return;
+            return true;
         }
-    }
+        return false;
+      });
   }
 
   void PerSquareLegalMovesFilter
@@ -59,6 +63,8 @@ namespace sxako::piece_2d_game {
   bool PerSquareLegalMovesFilter
   ::is_under_attack(Board const &b,
                     Location attackee, Color attackee_color) const {
+    if (attack_map)
+      return attack_map->is_attacked(b, attackee, enemy(attackee_color));
     bool under_attack=false;
     add_legal_move_f add_legal_move=
       [&under_attack, attackee](Move, list<Location> const &captures) {
@@ -100,6 +106,38 @@ namespace sxako::piece_2d_game {
     return any_legal_capture;
   }
 
+  bool PerSquareLegalMovesFilter
+  ::random_legal_move(Board const &b, Move &m,
+                      Rules::random_index_f const &random,
+                      unsigned n_tries) const {
+    size_t n;
+    // a uniformly random pseudo-legal move, if legal, is a uniformly random
+    // legal move
+    add_legal_move_f sample_pseudo_legal=
+      [&m, &n, &random](Move pm, list<Location> const &) {
+        if (random(++n)==0)
+          m=pm;
+        return false;
+      };
+    for (unsigned t=0; t<n_tries; ++t) {
+      n=0;
+      loop_through_squares(b, b(d.turn), sample_pseudo_legal, false, {});
+      if (n==0)
+        return false;
+      if (not is_move_illegal(b, m))
+        return true;
+    }
+    n=0;
+    add_legal_move_f sample_legal=
+      [this, &m, &n, &random, &b](Move lm, list<Location> const &) {
+        if (not is_move_illegal(b, lm) and random(++n)==0)
+          m=lm;
+        return false;
+      };
+    loop_through_squares(b, b(d.turn), sample_legal, false, {});
+    return n>0;
+  }
+
   bool PerSquareLegalMovesFilter
   ::is_move_illegal(Board const &b, Move m) const {
     for (is_move_illegal_f f: illegalities)
@@ -109,6 +147,48 @@ namespace sxako::piece_2d_game {
   }
 
 
+  bool LazyLegalMoves::any() {
+    return
+      wanted
+      ? not moves().empty()
+      : d.per_square.is_there_any_legal_move(b);
+  }
+
+  Moves &LazyLegalMoves::moves() {
+    if (not generated) {
+      legal_moves=d.legal_moves(b);
+      generated=true;
+    }
+    return legal_moves;
+  }
+
+  Rules::Outcome Piece2DGameData
+  ::outcome_and_legal_moves(Board const &b, Moves &moves) const {
+    LazyLegalMoves legal_moves(*this, b, true);
+    auto outcome=outcome_filters.outcome(b, legal_moves);
+    if (outcome==Rules::Outcome::playing)
+      moves=std::move(legal_moves.moves());
+    return outcome;
+  }
+
+  Rules::Outcome Piece2DGameData
+  ::outcome_and_random_legal_move(Board const &b, Move &m,
+                                  Rules::random_index_f const &random) const {
+    bool const sampled=legal_moves_filters.size()==1; // only "per_square"
+    LazyLegalMoves legal_moves(*this, b, not sampled);
+    auto outcome=outcome_filters.outcome(b, legal_moves);
+    if (outcome==Rules::Outcome::playing) {
+      if (sampled)
+        per_square.random_legal_move(b, m, random);
+      else {
+        auto const &moves=legal_moves.moves();
+        m=*next(moves.begin(), random(moves.size()));
+      }
+    }
+    return outcome;
+  }
+
+
   TurnChangeHandler::TurnChangeHandler(Piece2DGameData &d) {
     d.post_push_front_turn_handler(
       [&d](Board &b) { b(d.turn)=enemy(b(d.turn)); });
@@ -223,6 +303,50 @@ namespace sxako::piece_2d_game {
   }
 
 
+  PieceSquares::PieceSquares(Piece2DGameData &d)
+    : d(d),
+      enumeration_index(d.squares.cell_storage),
+      n_words((d.squares.all_enumerated_coords.size()+word_bits-1)/word_bits),
+      words(d.cache_spec, make_pair(0, int(2*n_words)-1)) {
+    auto const &coords=d.squares.all_enumerated_coords;
+    for (index_t i=0; i<coords.size(); ++i)
+      enumeration_index[d.squares.relative_cell_index(coords[i])]=i;
+    d.set_cache_functions.append(f_funct(this, &this_t::set_cache));
+    d.move_command_handler.append(f_funct(this, &this_t::move_handler));
+    d.capture_command_handler.append(f_funct(this, &this_t::capture_handler));
+    d.set_command_handler.append(f_funct(this, &this_t::set_handler));
+  }
+
+  template <typename D>
+  void PieceSquares::toggle(D &data, Square s, Location l) const {
+    if (not d.is_occupied(s))
+      return;
+    index_t i=index(l);
+    data(words)[u16(index_t(d.color_of(s))*n_words+i/word_bits)]^=
+      word_t(1)<<(i%word_bits);
+  }
+
+  void PieceSquares::set_cache(Data<Kind::cache> &cache,
+                               Data<Kind::state> const &state) const {
+    for (auto l: d.squares.all_enumerated_coords)
+      toggle(cache, state(d.squares)[l], l);
+  }
+
+  // the handlers are called before the squares change
+  void PieceSquares::move_handler(Board &b, Location from, Location to) const {
+    Square s_from=b(d.squares)[from];
+    toggle(b, b(d.squares)[to], to);
+    toggle(b, s_from, from);
+    toggle(b, s_from, to);
+  }
+  void PieceSquares::capture_handler(Board &b, Location captured) const
+    { toggle(b, b(d.squares)[captured], captured); }
+  void PieceSquares::set_handler(Board &b, Location l, Square new_s) const {
+    toggle(b, b(d.squares)[l], l);
+    toggle(b, new_s, l);
+  }
+
+
   void Piece2DGameData::board_move(Board &b, Move const &m) const {
     for (auto f: pre_turn_handlers)
       f(b);
@@ -246,6 +370,50 @@ namespace sxako::piece_2d_game {
         and (d_x*b_y==d_y*b_x);
     }
 
+    // a walk from a location along a displacement, on "squares" (the access
+    // to "Piece2DGameData::squares" in a board or a state); when the
+    // displacement can't jump over the board padding, it goes by linear cell
+    // index (see "StraightIndexing" in "straight"), and stops on the
+    // "off_board" sentinel, with no coordinate checks; otherwise, it goes by
+    // location
+    template <typename S>
+    class SquareWalk {
+    public:
+      SquareWalk(Piece2DGameData const &d, S const &squares,
+                 Location l, Displacement dis)
+        : d(d), squares(squares), dis(dis), to(l),
+          by_index(index_t(abs(get<0>(dis)))<=d.squares.padding
+                   and index_t(abs(get<1>(dis)))<=d.squares.padding),
+          step(by_index ? d.squares.index_step(dis) : 0),
+          i(by_index ? s_index_t(d.squares.relative_cell_index(l)) : 0) { }
+      // take a step; return whether "to" is still on the board, and if so,
+      // set "s" to its square
+      bool next(Square &s) {
+        to=to+dis;
+        if (by_index) {
+          Square next_s=squares.at_index(index_t(i+=step));
+          if (next_s==d.off_board)
+            return false;
+          s=next_s;
+          return true;
+        }
+        return squares.get_if_contains(to, s);
+      }
+      // the relative cell index of "to"
+      index_t cell() const
+        { return by_index ? index_t(i) : d.squares.relative_cell_index(to); }
+    private:
+      Piece2DGameData const &d;
+      S const squares;
+      Displacement const dis;
+    public:
+      Location to;
+    private:
+      bool const by_index;
+      s_index_t const step;
+      s_index_t i;
+    };
+
   }
 
   void can_move_straight(Piece2DGameData const &d,
@@ -255,15 +423,45 @@ namespace sxako::piece_2d_game {
                          Square l_s, Square change_to, // same: no change
                          bool only_capture, Location to_capture) {
     Color c=d.color_of(l_s);
+    Bitboards const *bitboards=d.bitboards;
+    SlideAttacks const *tables=bitboards ? bitboards->slide_attacks : nullptr;
+    SlideAttacks::bitboard_t occupied=0, enemies=0;
+    if (tables) {
+      occupied=bitboards->occupied(b);
+      enemies=bitboards->occupied(b, enemy(c));
+    }
     for (Displacement dis: steps) {
       if (only_capture and not simple_reachable(to_capture-l, dis))
         continue;
-      Location to=l+dis;
+      if (tables and SlideAttacks::is_step(dis)) {
+        // the same moves, in the same order, from the tables
+        bool growing=SlideAttacks::growing(dis);
+        for (auto to_bits=tables->attacks(dis, bitboards->bit(l), occupied);
+             to_bits;) {
+          index_t i=
+            growing
+            ? index_t(__builtin_ctzll(to_bits))
+            : 63-index_t(__builtin_clzll(to_bits));
+          to_bits^=SlideAttacks::bitboard_t(1)<<i;
+          Location to=bitboards->location(i);
+          if (not (occupied>>i&1)) {
+            if (add_move(make_move(l, to, l_s, change_to), {}))
+              return;
+          }
+          else if (enemies>>i&1) {
+            if (add_move(make_capture(to)+make_move(l, to, l_s, change_to),
+                         {to}))
+              return;
+          }
+        }
+        continue;
+      }
+      SquareWalk walk(d, b(d.squares), l, dis);
+      Location const &to=walk.to;
       Square s=empty;
-      while (b(d.squares).get_if_contains(to, s) and not d.is_occupied(s)) {
+      while (walk.next(s) and not d.is_occupied(s)) {
         if (add_move(make_move(l, to, l_s, change_to), {}))
           return;
-        to=to+dis;
       }
       if (d.is_occupied(s) and d.color_of(s) not_eq c) {
         if (add_move(make_capture(to)+make_move(l, to, l_s, change_to), {to}))
@@ -279,11 +477,35 @@ namespace sxako::piece_2d_game {
                          Square l_s, Square change_to, // same: no change
                          bool only_capture, Location to_capture) {
     Color c=d.color_of(l_s);
+    Bitboards const *bitboards=d.bitboards;
+    Bitboards::bitboard_t own=0, enemies=0;
+    index_t from=0;
+    if (bitboards) {
+      own=bitboards->occupied(b, c);
+      enemies=bitboards->occupied(b, enemy(c));
+      from=bitboards->bit(l);
+    }
     for (Displacement dis: steps) {
-      Location to=l+dis;
-      if (only_capture and (to not_eq to_capture))
+      if (only_capture and (l+dis not_eq to_capture))
+        continue;
+      if (bitboards and Bitboards::is_leap(dis)) {
+        // the same moves, in the same order, from the bitboards
+        index_t i=bitboards->leap(from, dis);
+        if (i==Bitboards::no_bit or own>>i&1)
+          continue;
+        Location to=bitboards->location(i);
+        if (not (enemies>>i&1)) {
+          if (add_move(make_move(l, to, l_s, change_to), {}))
+            return;
+        }
+        else if (add_move(make_capture(to)+make_move(l, to, l_s, change_to),
+                          {to}))
+          return;
         continue;
-      if (Square s; b(d.squares).get_if_contains(to, s)) {
+      }
+      SquareWalk walk(d, b(d.squares), l, dis);
+      Location const &to=walk.to;
+      if (Square s; walk.next(s)) {
         if (not d.is_occupied(s)) {
           if (add_move(make_move(l, to, l_s, change_to), {}))
             return;
@@ -306,10 +528,27 @@ namespace sxako::piece_2d_game {
       bool only_capture, Location) {
     if (only_capture)
       return;
+    Bitboards const *bitboards=d.bitboards;
+    Bitboards::bitboard_t occupied=0;
+    index_t from=0;
+    if (bitboards) {
+      occupied=bitboards->occupied(b);
+      from=bitboards->bit(l);
+    }
     for (Displacement dis: steps) {
-      Location to=l+dis;
-      if (Square s;
-          b(d.squares).get_if_contains(to, s) and not (d.is_occupied(s))) {
+      if (bitboards and Bitboards::is_leap(dis)) {
+        // the same moves, in the same order, from the bitboards
+        index_t i=bitboards->leap(from, dis);
+        if (i not_eq Bitboards::no_bit and not (occupied>>i&1)
+            and add_move(make_move(l, bitboards->location(i), empty,
+                                   change_to),
+                         {}))
+          return;
+        continue;
+      }
+      SquareWalk walk(d, b(d.squares), l, dis);
+      Location const &to=walk.to;
+      if (Square s; walk.next(s) and not (d.is_occupied(s))) {
         if (add_move(make_move(l, to, s, change_to), {}))
           return;
       }
@@ -327,19 +566,17 @@ namespace sxako::piece_2d_game {
     for (Displacement dis: steps) {
       if (only_capture and not simple_reachable(to_capture-l, dis))
         continue;
-      Location to=l+dis;
+      SquareWalk walk(d, b(d.squares), l, dis);
+      Location const &to=walk.to;
       Square s=empty;
       // non-capturing part of the move:
-      while (b(d.squares).get_if_contains(to, s) and not d.is_occupied(s)) {
+      while (walk.next(s) and not d.is_occupied(s)) {
         if (add_move(make_move(l, to, l_s, change_to), {}))
           return;
-        to=to+dis;
       }
       if (d.is_occupied(s)) { // capturing part of the move
         s=empty;
-        to=to+dis;
-        while (b(d.squares).get_if_contains(to, s) and not d.is_occupied(s))
-          to=to+dis;
+        while (walk.next(s) and not d.is_occupied(s)) { }
         if (d.is_occupied(s) and d.color_of(s) not_eq c) {
           if (add_move(make_capture(to)+make_move(l, to, l_s, change_to),
                        {to}))
@@ -361,9 +598,11 @@ namespace sxako::piece_2d_game {
       if (only_capture and not simple_reachable(to_capture-l, dis))
         continue;
       Board b_move=b;
-      Location last_l=l, to=l+dis;
+      SquareWalk walk(d, b(d.squares), l, dis);
+      Location const &to=walk.to;
+      Location last_l=l;
       Square s=empty;
-      while (b(d.squares).get_if_contains(to, s) and not d.is_occupied(s)) {
+      while (walk.next(s) and not d.is_occupied(s)) {
         if (not only_capture) {
           d.move_handler.handle(b_move, make_move(last_l, to));
           if (d.per_square.is_under_attack(b_move, to, c))
@@ -372,7 +611,6 @@ namespace sxako::piece_2d_game {
         if (add_move(make_move(l, to, l_s, change_to), {}))
           return;
         last_l=to;
-        to=to+dis;
       }
       if (d.is_occupied(s) and d.color_of(s) not_eq c) {
         if (add_move(make_capture(to)+make_move(l, to, l_s, change_to), {to}))
@@ -381,6 +619,459 @@ namespace sxako::piece_2d_game {
     }
   }
 
+  namespace {
+
+#ifdef __x86_64__
+    __attribute__((target("bmi2")))
+    u64 pext(u64 bits, u64 mask) { return _pext_u64(bits, mask); }
+    bool has_pext() { return __builtin_cpu_supports("bmi2"); }
+#else
+    u64 pext(u64, u64) { return 0; }
+    bool has_pext() { return false; }
+#endif
+
+    // the generator for the magic numbers ("xorshift64*")
+    class MagicRandom {
+    public:
+      MagicRandom(u64 seed) : state(seed) { }
+      // few bits set, which makes good magic numbers more likely
+      u64 sparse() { return next()&next()&next(); }
+    private:
+      u64 state;
+      u64 next() {
+        state^=state>>12;
+        state^=state<<25;
+        state^=state>>27;
+        return state*2685821657736338717ull;
+      }
+    };
+
+  }
+
+  SlideAttacks const &SlideAttacks::tables() {
+    static SlideAttacks const result(true);
+    return result;
+  }
+
+  bool SlideAttacks::is_step(Displacement dis) {
+    return
+      abs(get<0>(dis))<=1 and abs(get<1>(dis))<=1
+      and (get<0>(dis) or get<1>(dis));
+  }
+
+  SlideAttacks::bitboard_t SlideAttacks::attacks(
+      Slider slider, index_t from, bitboard_t occupied) const {
+    entry_t const &e=entries[index_t(slider)][from];
+    return table[e.offset+index(e, occupied)];
+  }
+
+  SlideAttacks::bitboard_t SlideAttacks::attacks(
+      Displacement dis, index_t from, bitboard_t occupied) const {
+    Slider slider=get<0>(dis) and get<1>(dis) ? Slider::bishop : Slider::rook;
+    return attacks(slider, from, occupied)&rays[ray_index(dis)][from];
+  }
+
+  size_t SlideAttacks::index(entry_t const &e, bitboard_t occupied) const {
+    return
+      use_pext
+      ? size_t(pext(occupied, e.mask))
+      : size_t(((occupied&e.mask)*e.magic)>>e.shift);
+  }
+
+  SlideAttacks::bitboard_t SlideAttacks::walk(
+      index_t from, Displacement dis, bitboard_t occupied) {
+    bitboard_t result=0;
+    for (int x=int(from%8)+get<0>(dis), y=int(from/8)+get<1>(dis);
+         x>=0 and x<8 and y>=0 and y<8;
+         x+=get<0>(dis), y+=get<1>(dis)) {
+      bitboard_t bit=bitboard_t(1)<<(8*y+x);
+      result|=bit;
+      if (occupied&bit)
+        break;
+    }
+    return result;
+  }
+
+  SlideAttacks::SlideAttacks(bool pext_if_available)
+    : use_pext(pext_if_available and has_pext()) {
+    // local, since the tables can be built during static initialization
+    series<Displacement> const slider_steps[2]={
+      {{ 0, +1}, {-1,  0}, {+1,  0}, { 0, -1}},
+      {{-1, +1}, {+1, +1}, {-1, -1}, {+1, -1}}};
+    // seeds that find the magic numbers quickly, by row
+    u64 const seeds[8]={728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+    std::vector<bitboard_t> occupancies, references;
+    for (index_t k=0; k<2; ++k)
+      for (index_t from=0; from<64; ++from) {
+        entry_t &e=entries[k][from];
+        for (Displacement dis: slider_steps[k]) {
+          bitboard_t ray=rays[ray_index(dis)][from]=walk(from, dis, 0);
+          // the last location of the ray never blocks
+          if (ray)
+            e.mask|=
+              ray&~(growing(dis)
+                    ? bitboard_t(1)<<(63-__builtin_clzll(ray))
+                    : bitboard_t(1)<<__builtin_ctzll(ray));
+        }
+        unsigned n_bits=unsigned(__builtin_popcountll(e.mask));
+        e.shift=64-n_bits;
+        e.offset=table.size();
+        table.resize(e.offset+(size_t(1)<<n_bits));
+        // every subset of the mask
+        occupancies.clear();
+        references.clear();
+        bitboard_t o=0;
+        do {
+          occupancies.push_back(o);
+          bitboard_t reference=0;
+          for (Displacement dis: slider_steps[k])
+            reference|=walk(from, dis, o);
+          references.push_back(reference);
+          o=(o-e.mask)&e.mask;
+        } while (o);
+        if (use_pext) {
+          for (size_t i=0; i<occupancies.size(); ++i)
+            table[e.offset+index(e, occupancies[i])]=references[i];
+          continue;
+        }
+        // try magic numbers until one maps the subsets with different
+        // attacks to different entries
+        MagicRandom random(seeds[from/8]);
+        std::vector<unsigned> tried(size_t(1)<<n_bits, 0);
+        for (unsigned attempt=1; ; ++attempt) {
+          do
+            e.magic=random.sparse();
+          while (__builtin_popcountll((e.mask*e.magic)>>56)<6);
+          size_t i=0;
+          for (; i<occupancies.size(); ++i) {
+            bitboard_t &entry=table[e.offset+index(e, occupancies[i])];
+            size_t tried_i=size_t(&entry-&table[e.offset]);
+            if (tried[tried_i]<attempt) {
+              tried[tried_i]=attempt;
+              entry=references[i];
+            }
+            else if (entry not_eq references[i])
+              break;
+          }
+          if (i==occupancies.size())
+            break;
+        }
+      }
+  }
+
+
+  Bitboards::Bitboards(Piece2DGameData &d)
+    : d(d), masks(d.cache_spec, d.piece_box.square_range) {
+    if (not fit(d))
+      throw logic_error("too many locations for bitboards");
+    auto const &coords=d.squares.all_enumerated_coords;
+    bool is_8x8=coords.size()==64;
+    for (index_t i=0; is_8x8 and i<coords.size(); ++i)
+      is_8x8=
+        get_x(coords[i])==get_x(coords[0])+int(i%8)
+        and get_y(coords[i])==get_y(coords[0])+int(i/8);
+    if (is_8x8)
+      slide_attacks=&SlideAttacks::tables();
+    for (index_t i=0; i<coords.size(); ++i)
+      for (coord_t y=-2; y<=2; ++y)
+        for (coord_t x=-2; x<=2; ++x) {
+          Location to=coords[i]+Displacement(x, y);
+          leaps[i][index_t(5*(y+2)+x+2)]=
+            u8(d.squares.contains(to) ? bit(to) : no_bit);
+        }
+    d.bitboards=this;
+    d.set_cache_functions.append(f_funct(this, &this_t::set_cache));
+    d.move_command_handler.append(f_funct(this, &this_t::move_handler));
+    d.capture_command_handler.append(f_funct(this, &this_t::capture_handler));
+    d.set_command_handler.append(f_funct(this, &this_t::set_handler));
+  }
+
+  template <typename D>
+  void Bitboards::toggle(D &data, Square s, Location l) const {
+    if (d.is_occupied(s))
+      data(masks)[s]^=bitboard_t(1)<<bit(l);
+  }
+
+  void Bitboards::set_cache(Data<Kind::cache> &cache,
+                            Data<Kind::state> const &state) const {
+    for (auto l: d.squares.all_enumerated_coords)
+      toggle(cache, state(d.squares)[l], l);
+  }
+
+  // the handlers are called before the squares change
+  void Bitboards::move_handler(Board &b, Location from, Location to) const {
+    Square s_from=b(d.squares)[from];
+    toggle(b, b(d.squares)[to], to);
+    toggle(b, s_from, from);
+    toggle(b, s_from, to);
+  }
+  void Bitboards::capture_handler(Board &b, Location captured) const
+    { toggle(b, b(d.squares)[captured], captured); }
+  void Bitboards::set_handler(Board &b, Location l, Square new_s) const {
+    toggle(b, b(d.squares)[l], l);
+    toggle(b, new_s, l);
+  }
+
+
+  AttackMap::AttackMap(Piece2DGameData &d,
+                       attacks_t leap_attacks, attacks_t slide_attacks)
+    : d(d), n_cells(d.squares.cell_storage) {
+    for (auto const &ss_steps: leap_attacks)
+      for (Square s: ss_steps.first)
+        leaps[s].insert(leaps[s].end(),
+                        ss_steps.second.begin(), ss_steps.second.end());
+    for (auto const &ss_steps: slide_attacks)
+      for (Displacement dis: ss_steps.second) {
+        index_t i=0;
+        while (i<directions.size()
+               and not (get<0>(directions[i])==get<0>(dis)
+                        and get<1>(directions[i])==get<1>(dis)))
+          ++i;
+        if (i==directions.size()) {
+          if (i==8*sizeof(directions_t))
+            throw logic_error("too many slide directions");
+          directions.push_back(dis);
+        }
+        for (Square s: ss_steps.first)
+          slides[s]|=directions_t(1u<<i);
+      }
+    if (Bitboards::fit(d)) {
+      if (not d.bitboards)
+        own_bitboards.emplace(d);
+      bitboards=d.bitboards;
+      slide_tables=bitboards->slide_attacks;
+      for (index_t s=0; slide_tables and s<n_squares; ++s) {
+        // a square value must slide along all the rook steps, or none, and
+        // likewise for the bishop steps
+        unsigned n_steps[2]={0, 0};
+        for (index_t i=0; i<directions.size(); ++i)
+          if (slides[s]>>i&1) {
+            if (SlideAttacks::is_step(directions[i]))
+              ++n_steps[get<0>(directions[i]) and get<1>(directions[i])];
+            else
+              slide_tables=nullptr;
+          }
+        for (index_t k=0; k<2; ++k)
+          if (n_steps[k]==4)
+            table_sliders[k][index_t(d.color_of(Square(s)))]
+              .push_back(Square(s));
+          else if (n_steps[k])
+            slide_tables=nullptr;
+      }
+      auto const &coords=d.squares.all_enumerated_coords;
+      for (index_t s=0; s<n_squares; ++s)
+        if (not leaps[s].empty()) {
+          leapers[index_t(d.color_of(Square(s)))].push_back(Square(s));
+          leaps_to[s].resize(coords.size());
+          for (Location l: coords)
+            for (Displacement dis: leaps[s])
+              if (Location from=l-dis; d.squares.contains(from))
+                leaps_to[s][bitboards->bit(l)]|=
+                  bitboard_t(1)<<bitboards->bit(from);
+        }
+      behind.resize(directions.size()*max_locations);
+      behind_growing.resize(behind.size());
+      for (index_t i=0; i<directions.size(); ++i)
+        for (Location l: coords) {
+          index_t bi=behind_index(i, l), last=bitboards->bit(l);
+          for (Location from=l-directions[i]; d.squares.contains(from);
+               from=from-directions[i]) {
+            index_t from_bit=bitboards->bit(from);
+            if (not behind[bi])
+              behind_growing[bi]=from_bit>last;
+            else if ((from_bit>last) not_eq behind_growing[bi])
+              throw logic_error("board order not monotonic along a line");
+            behind[bi]|=bitboard_t(1)<<from_bit;
+            last=from_bit;
+          }
+        }
+    }
+    else {
+      leaps_in.emplace(d.cache_spec, make_pair(0, int(2*n_cells)-1));
+      slides_in.emplace(d.cache_spec, make_pair(0, int(2*n_cells)-1));
+      d.set_cache_functions.append(f_funct(this, &this_t::set_cache));
+      d.move_command_handler.append(f_funct(this, &this_t::move_handler));
+      d.capture_command_handler.append(
+        f_funct(this, &this_t::capture_handler));
+      d.set_command_handler.append(f_funct(this, &this_t::set_handler));
+    }
+    d.per_square.attack_map=this;
+  }
+
+  bool AttackMap::is_attacked(Board const &b, Location l, Color by) const {
+    if (not bitboards) {
+      u16 ci=cell_index(by, l);
+      return b(leaps_in)[ci] or b(slides_in)[ci];
+    }
+    index_t l_bit=bitboards->bit(l);
+    for (Square s: leapers[index_t(by)])
+      if (leaps_to[s][l_bit]&bitboards->of(b, s))
+        return true;
+    if (slide_tables) {
+      bitboard_t occupied=bitboards->occupied(b);
+      for (index_t k=0; k<2; ++k) {
+        bitboard_t sliders=0;
+        for (Square s: table_sliders[k][index_t(by)])
+          sliders|=bitboards->of(b, s);
+        if (sliders
+            and slide_tables->attacks(SlideAttacks::Slider(k), l_bit,
+                                      occupied)&sliders)
+          return true;
+      }
+      return false;
+    }
+    for (index_t i=0; i<directions.size(); ++i)
+      if (Square s; nearest_behind(b, l, i, s)
+                    and slides[s]>>i&1 and d.color_of(s)==by)
+        return true;
+    return false;
+  }
+
+  bool AttackMap::nearest_behind(Board const &b, Location l, index_t i,
+                                 Square &s) const {
+    index_t bi=behind_index(i, l);
+    bitboard_t pieces=behind[bi]&bitboards->occupied(b);
+    if (not pieces)
+      return false;
+    index_t nearest=
+      behind_growing[bi]
+      ? index_t(__builtin_ctzll(pieces))
+      : max_locations-1-index_t(__builtin_clzll(pieces));
+    s=b(d.squares)[bitboards->location(nearest)];
+    return true;
+  }
+
+  bool AttackMap::slide_reaches(Board const &b, Location l, index_t i,
+                                Color by) const {
+    if (not bitboards)
+      return b(slides_in)[cell_index(by, l)]>>i&1;
+    Square s;
+    return nearest_behind(b, l, i, s) and slides[s]>>i&1
+      and d.color_of(s)==by;
+  }
+
+  template <typename S, typename L, typename T>
+  void AttackMap::attack(S const &squares_a, L leaps_in_a, T slides_in_a,
+                         Location l, Square s, bool on) const {
+    Color c=d.color_of(s);
+    for (Displacement dis: leaps[s]) {
+      SquareWalk walk(d, squares_a, l, dis);
+      if (Square to_s; walk.next(to_s))
+        leaps_in_a[cell_index(c, walk.cell())]+=on ? +1 : -1;
+    }
+    for (directions_t ds=slides[s]; ds; ds&=directions_t(ds-1))
+      slide(squares_a, slides_in_a,
+            c, l, index_t(__builtin_ctz(ds)), on);
+  }
+
+  template <typename S, typename T>
+  void AttackMap::slide(S const &squares_a, T slides_in_a,
+                        Color c, Location l, index_t i, bool on) const {
+    directions_t bit=directions_t(1u<<i);
+    SquareWalk walk(d, squares_a, l, directions[i]);
+    Square s;
+    while (walk.next(s)) {
+      auto &in=slides_in_a[cell_index(c, walk.cell())];
+      in=directions_t(on ? in|bit : in&~bit);
+      if (d.is_occupied(s))
+        return;
+    }
+  }
+
+  bool AttackMap::stays_safe(Board const &b, Move const &m,
+                             Location l, Color c) const {
+    Color by=enemy(c);
+    if (is_attacked(b, l, by))
+      return false;
+    auto reveals=[this, &b, l, by](Location vacated) {
+      if (vacated==l)
+        return true;
+      for (index_t i=0; i<directions.size(); ++i)
+        if (simple_reachable(l-vacated, directions[i])
+            and slide_reaches(b, vacated, i, by))
+          return true;
+      return false;
+    };
+    MoveStream ms(m);
+    while (ms) {
+      switch (ms.get<command_code_t>()) {
+      case label_code:
+      case suffix_code:
+        ms.get<string>();
+        break;
+      case move_code:
+        {
+          Location from=ms.get<Location>();
+          ms.get<Location>();
+          Square s_from=b(d.squares)[from];
+          if (reveals(from)
+              or (d.is_occupied(s_from) and d.color_of(s_from)==by))
+            return false;
+        } break;
+      case capture_code:
+        if (reveals(ms.get<Location>()))
+          return false;
+        break;
+      case set_code:
+        {
+          Location at=ms.get<Location>();
+          Square s=ms.get<Square>();
+          if (d.is_occupied(s) ? d.color_of(s)==by : reveals(at))
+            return false;
+        } break;
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void AttackMap::change(Board &b, Location l, Square new_s) const {
+    Square &s_l=b(d.squares)[l], old_s=s_l;
+    if (old_s==new_s)
+      return;
+    attack(b(d.squares), b(leaps_in), b(slides_in), l, old_s, false);
+    if (d.is_occupied(old_s) not_eq d.is_occupied(new_s)) {
+      // the slides reaching "l" now go past it, or no longer do
+      bool on=d.is_occupied(old_s);
+      for (Color c: enumerated_colors)
+        for (directions_t ds=b(slides_in)[cell_index(c, l)];
+             ds; ds&=directions_t(ds-1))
+          slide(b(d.squares), b(slides_in),
+                c, l, index_t(__builtin_ctz(ds)), on);
+    }
+    s_l=new_s;
+    attack(b(d.squares), b(leaps_in), b(slides_in), l, new_s, true);
+  }
+
+  void AttackMap::set_cache(Data<Kind::cache> &cache,
+                            Data<Kind::state> const &state) const {
+    for (auto l: d.squares.all_enumerated_coords)
+      attack(state(d.squares), cache(leaps_in), cache(slides_in),
+             l, state(d.squares)[l], true);
+  }
+
+  // the handlers are called before the squares change; "change()" changes
+  // them, so they're put back for the main handler
+  void AttackMap::move_handler(Board &b, Location from, Location to) const {
+    Square s_from=b(d.squares)[from], s_to=b(d.squares)[to];
+    change(b, from, empty);
+    change(b, to, s_from);
+    b(d.squares)[from]=s_from;
+    b(d.squares)[to]=s_to;
+  }
+  void AttackMap::capture_handler(Board &b, Location captured) const {
+    Square s=b(d.squares)[captured];
+    change(b, captured, empty);
+    b(d.squares)[captured]=s;
+  }
+  void AttackMap::set_handler(Board &b, Location l, Square new_s) const {
+    Square s=b(d.squares)[l];
+    change(b, l, new_s);
+    b(d.squares)[l]=s;
+  }
+
+
   TrackPiece::TrackPiece(Piece2DGameData &d,
                          MoveCommandHandler &move_command_handler,
                          Piece p)
@@ -392,11 +1083,20 @@ namespace sxako::piece_2d_game {
 
   void TrackPiece::set_cache(Data<Kind::cache> &cache,
                              Data<Kind::state> const &state) const {
-    for (Color c: enumerated_colors)
+    // the "PieceSquares" bitsets are already in the cache (their set-cache
+    // function is appended by "Piece2DGameData" itself, before any game's);
+    // as when walking the board, the last tracked piece of each color wins
+    for (Color c: enumerated_colors) {
       cache(tracked_location)[c]=Location();
-    for (auto l: d.squares.all_enumerated_coords)
-      if (d.piece_of(state(d.squares)[l])==p)
-        cache(tracked_location)[d.color_of(state(d.squares)[l])]=l;
+      d.piece_squares.for_each(
+        cache, c, true,
+        [&](Location l) {
+          if (d.piece_of(state(d.squares)[l]) not_eq p)
+            return false;
+          cache(tracked_location)[c]=l;
+          return true;
+        });
+    }
   }
 
   void TrackPiece::move_handler(Board &b, Location from, Location to) const {
@@ -414,7 +1114,8 @@ namespace sxako::piece_2d_game {
       black_royal_squares(black_royal_squares)
     { d.outcome_filters.append(f_funct(this, &this_t::outcome_filter)); }
 
-  void LoseIfNoRoyal::outcome_filter(Rules::Outcome &o, Board const &b) const {
+  void LoseIfNoRoyal::outcome_filter(Rules::Outcome &o, Board const &b,
+                                     LazyLegalMoves &) const {
     if (o not_eq Rules::Outcome::playing)
       return;
     Color c=b(d.turn);
@@ -431,10 +1132,11 @@ namespace sxako::piece_2d_game {
     { d.outcome_filters.append(f_funct(this, &this_t::outcome_filter)); }
 
   void LoseIfNoLegalMove
-  ::outcome_filter(Rules::Outcome &o, Board const &b) const {
+  ::outcome_filter(Rules::Outcome &o, Board const &,
+                   LazyLegalMoves &legal_moves) const {
     if (o not_eq Rules::Outcome::playing)
       return;
-    if (not per_square.is_there_any_legal_move(b))
+    if (not legal_moves.any())
       o=Rules::Outcome::last_move_won;
   }
 
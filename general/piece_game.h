@@ -5,6 +5,7 @@
 #include "board.h"
 #include "straight.h"
 #include <map>
+#include <optional>
 
 namespace sxako::piece_2d_game {
 
@@ -160,6 +161,7 @@ namespace sxako::piece_2d_game {
   using namespace piece_box;
 
   struct Piece2DGameData;
+  struct Bitboards;
 
   // the legal moves filters are a sequence of filters that modify a list of
   // legal moves starting from the current board status; each filter can access
@@ -170,6 +172,7 @@ namespace sxako::piece_2d_game {
     : private Sequence<legal_moves_filter_f> {
   public:
     using Sequence<legal_moves_filter_f>::append;
+    size_t size() const { return elements.size(); }
     Moves legal_moves(Board const &b) const {
       Moves moves;
       for (auto f: elements)
@@ -228,7 +231,8 @@ namespace sxako::piece_2d_game {
   //       able to capture (e.g., a non-capturing move generator can return
   //       immediately if "only_capture" is "true"; a generator for rook-like
   //       straight moves can return immediately if "only_capture" is "true"
-  //       and "to_capture" is in a different row and column from "from")
+  //       and "to_capture" is in a different row and column from "from"); if
+  //       the game has an "AttackMap", the answer is looked up in it instead
   //
   //     * determining if there is any valid legal move; this is done with the
   //       "is_there_any_legal_move()" method; the method scans the board in
@@ -240,6 +244,16 @@ namespace sxako::piece_2d_game {
   //     * determining if there is any valid legal capture move; this is done
   //       with the "is_there_any_legal_capture()" method, and works similarly
   //       to "is_there_any_legal_move()"
+  //
+  //     * picking a uniformly random legal move, without building the list;
+  //       this is done with the "random_legal_move()" method; it first tries
+  //       (up to "n_tries" times) a uniformly random pseudo-legal move (i.e.,
+  //       as reported by the generators), checking its illegality only once
+  //       picked, and accepts it if legal (so that illegality checks, which
+  //       are the expensive part, are rarely run more than once); if every
+  //       try fails, it picks among the moves that pass the illegality checks;
+  //       the random pick is made by reservoir sampling over the reported
+  //       moves; the returned value is "false" iff there's no legal move
   using add_legal_move_f= // returns true if no more moves are needed
     std::function<bool (Move, std::list<Location> const &captures)>;
   using per_square_add_legal_moves_f=
@@ -248,6 +262,7 @@ namespace sxako::piece_2d_game {
                         bool only_capture, Location to_capture)>;
   using is_move_illegal_f=
     std::function<bool (Board const &, Move)>;
+  struct AttackMap;
   class PerSquareLegalMovesFilter { using this_t=PerSquareLegalMovesFilter;
   public:
     PerSquareLegalMovesFilter(Piece2DGameData &d);
@@ -258,7 +273,11 @@ namespace sxako::piece_2d_game {
                          Location attackee, Color attackee_color) const;
     bool is_there_any_legal_move(Board const &b) const;
     bool is_there_any_legal_capture(Board const &b) const;
+    bool random_legal_move(Board const &b, Move &m,
+                           Rules::random_index_f const &random,
+                           unsigned n_tries=4) const;
     Piece2DGameData const &d;
+    AttackMap const *attack_map=nullptr; // set by the "AttackMap", if any
   private:
     bool is_move_illegal(Board const &b, Move m) const;
     std::array<std::list<per_square_add_legal_moves_f>, n_squares>
@@ -292,16 +311,38 @@ namespace sxako::piece_2d_game {
     }
   };
 
+  // the legal moves of a board, as seen by the outcome filters; if the caller
+  // wants the legal moves anyway ("wanted" is "true"), a filter that needs to
+  // know whether there's any legal move (e.g., for checkmate) generates the
+  // whole list, which is then handed to the caller instead of being generated
+  // again; otherwise, "any()" resorts to the quicker
+  // "PerSquareLegalMovesFilter::is_there_any_legal_move()" (which gives the
+  // same answer as long as the other legal moves filters never empty a
+  // non-empty list)
+  class LazyLegalMoves {
+  public:
+    LazyLegalMoves(Piece2DGameData const &d, Board const &b, bool wanted)
+      : d(d), b(b), wanted(wanted) { }
+    bool any();
+    Moves &moves(); // generated on first access
+  private:
+    Piece2DGameData const &d;
+    Board const &b;
+    bool const wanted;
+    bool generated=false;
+    Moves legal_moves;
+  };
+
   using outcome_filter_f=
-    std::function<void (Rules::Outcome &, Board const &)>;
+    std::function<void (Rules::Outcome &, Board const &, LazyLegalMoves &)>;
   class OutcomeFilters
     : private Sequence<outcome_filter_f> {
   public:
     using Sequence<outcome_filter_f>::append;
-    Rules::Outcome outcome(Board const &b) const {
+    Rules::Outcome outcome(Board const &b, LazyLegalMoves &legal_moves) const {
       Rules::Outcome outcome=Rules::Outcome::playing;
       for (auto f: elements)
-        f(outcome, b);
+        f(outcome, b, legal_moves);
       return outcome;
     }
   };
@@ -405,6 +446,48 @@ namespace sxako::piece_2d_game {
     void set_handler(Board &b, Location l, Square new_s) const;
   };
 
+  // the squares holding each color's pieces, kept as a bitset over the order
+  // of "squares.all_enumerated_coords", so that the pieces can be visited in
+  // that order (or in reverse), skipping the empty squares
+  struct PieceSquares { using this_t=PieceSquares;
+    PieceSquares(Piece2DGameData &d);
+    Piece2DGameData const &d;
+    // call "f(l)" for the location "l" of each of "c"'s pieces, in order (or
+    // in reverse), until it returns "true"; "D" is "Board" or
+    // "Data<Kind::cache>" (for the set-cache functions that come after this
+    // one's)
+    template <typename D, typename F>
+    void for_each(D const &data, Color c, bool reversed, F const &f) const;
+    // the same, for the pieces of both colors, in order
+    template <typename F>
+    void for_each(Board const &b, F const &f) const;
+    using word_t=u64;
+    static constexpr index_t word_bits=64;
+    // the position of location "l" in the order (its bit, in the word
+    // "index(l)/word_bits")
+    index_t index(Location l) const;
+    // word "w" of the bitset for "c"
+    template <typename D>
+    word_t const &word(D const &data, Color c, index_t w) const
+      { return data(words)[u16(index_t(c)*n_words+w)]; }
+  private:
+    std::vector<index_t> enumeration_index; // by "squares" relative index
+    index_t const n_words; // per color
+    Addressing<Kind::cache, Straight<u16>, word_t> const words;
+    template <typename F>
+    bool for_each_in_word(word_t bits, index_t w, bool reversed,
+                          F const &f) const;
+    // flip the bit for location "l", if square "s" holds a piece; "D" is
+    // "Board" or "Data<Kind::cache>"
+    template <typename D>
+    void toggle(D &data, Square s, Location l) const;
+    void set_cache(Data<Kind::cache> &cache,
+                   Data<Kind::state> const &state) const;
+    void move_handler(Board &b, Location from, Location to) const;
+    void capture_handler(Board &b, Location captured) const;
+    void set_handler(Board &b, Location l, Square new_s) const;
+  };
+
   struct Piece2DGameData {
     Piece2DGameData(Piece2DGameData const &)=delete;
     template <typename... SquaresA>
@@ -413,9 +496,14 @@ namespace sxako::piece_2d_game {
       : piece_box(piece_box_),
         squares(state_spec, squares_a...),
         square_count(*this, piece_box.square_range) {
+      if (piece_box.square_range.second>=off_board)
+        throw std::logic_error("too many squares in the piece box");
       assign_data(table(piece), piece_box.list_square_piece());
       assign_data(table(color), piece_box.list_square_color());
       assign_data(table(occupied), piece_box.list_square_occupied());
+      table(occupied)[off_board]=true;
+      for (index_t i: squares.off_board_indices)
+        state_spec.set_initial(squares.address_of_index(i), off_board);
     }
 
     PieceBox const &piece_box;
@@ -425,8 +513,12 @@ namespace sxako::piece_2d_game {
     DataSpec<Kind::cache> cache_spec;
     DataSpec<Kind::table> table_spec;
 
-    // basic state
+    // basic state; the board can be padded (see "StraightIndexing" in
+    // "straight"), and the padding then holds the sentinel "off_board", which
+    // counts as occupied, so that a walk along a line stops there (see
+    // "SquareWalk")
     Addressing<Kind::state, SingleVar, Color> const turn{state_spec};
+    static constexpr Square off_board=n_squares-1;
     Addressing<Kind::state, Straight2D<>, Square> const squares;
 
     // conversion tables
@@ -453,8 +545,21 @@ namespace sxako::piece_2d_game {
       { return set_cache_functions.compute_cache(cache_spec, state); }
 
     OutcomeFilters outcome_filters;
-    Rules::Outcome outcome(Board const &b) const
-      { return outcome_filters.outcome(b); }
+    // draw by repetition, given the positions that led to the board (see
+    // "PositionPath"); games with such a rule set it
+    std::function<bool (Board const &, PositionPath const &)> repetition;
+    bool repeated(Board const &b, PositionPath const &path) const
+      { return repetition and repetition(b, path); }
+    Rules::Outcome outcome(Board const &b) const {
+      LazyLegalMoves no_legal_moves(*this, b, false);
+      return outcome_filters.outcome(b, no_legal_moves);
+    }
+    Rules::Outcome outcome_and_legal_moves(Board const &b, Moves &moves) const;
+    // the random legal move is sampled from "per_square" if there's no other
+    // legal moves filter, and picked from the whole list otherwise
+    Rules::Outcome
+    outcome_and_random_legal_move(Board const &b, Move &m,
+                                  Rules::random_index_f const &random) const;
 
     Initialization initialization;
     void initialize(Board &b)
@@ -481,10 +586,52 @@ namespace sxako::piece_2d_game {
     CaptureCommandHandler capture_command_handler{*this};
     SetCommandHandler set_command_handler{*this};
     SquareCount square_count;
+    PieceSquares piece_squares{*this};
+    Bitboards const *bitboards=nullptr; // set by the "Bitboards", if any
+    // the number of squares "s" on the board (e.g., for material): the
+    // popcount of its bitboard, if any, or its count otherwise
+    unsigned count(Board const &b, Square s) const;
 
     void board_move(Board &b, Move const &m) const;
   };
 
+  inline index_t PieceSquares::index(Location l) const
+    { return enumeration_index[d.squares.relative_cell_index(l)]; }
+
+  template <typename F>
+  bool PieceSquares::for_each_in_word(word_t bits, index_t w, bool reversed,
+                                      F const &f) const {
+    auto const &coords=d.squares.all_enumerated_coords;
+    while (bits) {
+      index_t i=
+        reversed
+        ? word_bits-1-index_t(__builtin_clzll(bits))
+        : index_t(__builtin_ctzll(bits));
+      bits^=word_t(1)<<i;
+      if (f(coords[w*word_bits+i]))
+        return true;
+    }
+    return false;
+  }
+
+  template <typename D, typename F>
+  void PieceSquares::for_each(D const &data, Color c, bool reversed,
+                              F const &f) const {
+    for (index_t k=0; k<n_words; ++k) {
+      index_t w=reversed ? n_words-1-k : k;
+      if (for_each_in_word(word(data, c, w), w, reversed, f))
+        return;
+    }
+  }
+
+  template <typename F>
+  void PieceSquares::for_each(Board const &b, F const &f) const {
+    for (index_t w=0; w<n_words; ++w)
+      if (for_each_in_word(word(b, Color::white, w)|word(b, Color::black, w),
+                           w, false, f))
+        return;
+  }
+
   struct SimpleMoves {
     template <typename G, typename S>
     SimpleMoves(PerSquareLegalMovesFilter &per_square_legal_moves_filter,
@@ -583,6 +730,205 @@ namespace sxako::piece_2d_game {
     void move_handler(Board &b, Location from, Location to) const;
   };
 
+  // the sliding attacks on an 8x8 board, whose bitboards hold the location
+  // at column "x" and row "y" (counted from the first location) at bit
+  // "8*y+x": for each bit, the bits a rook or a bishop attacks from it (up to
+  // and including the first occupied one along each direction), given the
+  // occupancy; they're looked up in a table, indexed by the occupancy of the
+  // bits that can block, either extracted with the BMI2 "pext" instruction,
+  // if the processor has it, or hashed by multiplying with a "magic" number,
+  // searched for when the table is built
+  class SlideAttacks {
+  public:
+    using bitboard_t=u64;
+    enum class Slider { rook, bishop };
+    // the tables, built on first use
+    static SlideAttacks const &tables();
+    // tables indexed with "pext" (only if the processor has it) or with magic
+    // numbers, whatever "tables()" uses; for testing both
+    explicit SlideAttacks(bool pext_if_available);
+    bitboard_t attacks(Slider slider, index_t from,
+                       bitboard_t occupied) const;
+    // whether "dis" is a rook or a bishop step
+    static bool is_step(Displacement dis);
+    // the attacks from "from" along rook or bishop step "dis"
+    bitboard_t attacks(Displacement dis, index_t from,
+                       bitboard_t occupied) const;
+    // whether the bits grow along step "dis"
+    static bool growing(Displacement dis)
+      { return 8*get<1>(dis)+get<0>(dis)>0; }
+    // whether the tables are indexed with "pext"
+    bool uses_pext() const { return use_pext; }
+    // the attacks from "from" along step "dis", walked bit by bit (the
+    // reference for the tables)
+    static bitboard_t walk(index_t from, Displacement dis,
+                           bitboard_t occupied);
+  private:
+    struct entry_t {
+      bitboard_t mask=0, magic=0;
+      unsigned shift=0;
+      size_t offset=0;
+    };
+    bool const use_pext;
+    std::array<std::array<entry_t, 64>, 2> entries;
+    std::vector<bitboard_t> table;
+    // the bits along each step (see "ray_index()"), by bit
+    std::array<std::array<bitboard_t, 64>, 9> rays;
+    static index_t ray_index(Displacement dis)
+      { return index_t(3*(get<1>(dis)+1)+get<0>(dis)+1); }
+    size_t index(entry_t const &e, bitboard_t occupied) const;
+  };
+
+  // for boards of up to 64 locations, a bitboard for each square value, with
+  // the locations holding it; like the bitsets of "PieceSquares" (whose only
+  // word for each color is then the color's occupancy bitboard), they follow
+  // the order of "squares.all_enumerated_coords"; on 8x8 boards, whose order
+  // is that of "SlideAttacks", its tables are available, and "straight" moves
+  // along rook and bishop steps are found in them
+  //
+  // the short steps (see "is_leap()") from each location are tabulated, so
+  // that "one_step" moves, pawn moves and draughts moves are found on the
+  // occupancy bitboards, without reading the board; a game gets bitboards by
+  // constructing them, or through an "AttackMap"
+  struct Bitboards { using this_t=Bitboards;
+    using bitboard_t=PieceSquares::word_t;
+    static constexpr index_t max_locations=PieceSquares::word_bits;
+    Bitboards(Piece2DGameData &d);
+    Piece2DGameData const &d;
+    SlideAttacks const *slide_attacks=nullptr; // on 8x8 boards
+    static bool fit(Piece2DGameData const &d)
+      { return d.squares.all_enumerated_coords.size()<=max_locations; }
+    bitboard_t of(Board const &b, Square s) const { return b(masks)[s]; }
+    bitboard_t occupied(Board const &b, Color c) const
+      { return d.piece_squares.word(b, c, 0); }
+    bitboard_t occupied(Board const &b) const
+      { return occupied(b, Color::white)|occupied(b, Color::black); }
+    index_t bit(Location l) const { return d.piece_squares.index(l); }
+    Location location(index_t i) const
+      { return d.squares.all_enumerated_coords[i]; }
+    // the bit one step "dis" away from bit "i", for the steps of up to two
+    // locations along each axis; "no_bit" if that's off the board
+    static constexpr index_t no_bit=max_locations;
+    static bool is_leap(Displacement dis)
+      { return abs(get<0>(dis))<=2 and abs(get<1>(dis))<=2; }
+    static bool are_leaps(series<Displacement> const &steps)
+      { return std::all_of(steps.begin(), steps.end(), is_leap); }
+    index_t leap(index_t i, Displacement dis) const
+      { return leaps[i][index_t(5*(get<1>(dis)+2)+get<0>(dis)+2)]; }
+  private:
+    Addressing<Kind::cache, Straight<Square>, bitboard_t> const masks;
+    std::array<std::array<u8, 25>, max_locations> leaps;
+    template <typename D>
+    void toggle(D &data, Square s, Location l) const;
+    void set_cache(Data<Kind::cache> &cache,
+                   Data<Kind::state> const &state) const;
+    void move_handler(Board &b, Location from, Location to) const;
+    void capture_handler(Board &b, Location captured) const;
+    void set_handler(Board &b, Location l, Square new_s) const;
+  };
+
+  inline unsigned Piece2DGameData::count(Board const &b, Square s) const {
+    return
+      bitboards
+      ? unsigned(__builtin_popcountll(bitboards->of(b, s)))
+      : b(square_count.counts)[s];
+  }
+
+  // the attacks of each color on each location (i.e., whether a piece of the
+  // color could capture an enemy piece there), so that
+  // "PerSquareLegalMovesFilter::is_under_attack()" (which the attack map takes
+  // over once constructed) is a lookup; the attacks are declared per square
+  // value, as "leaps" (one step along each displacement, like a knight, or a
+  // pawn capturing) and "slides" (along each displacement, up to and including
+  // the first occupied location, like a rook)
+  //
+  // on boards of up to 64 locations, the attacks are found on the bitboards
+  // (see "Bitboards"): the locations a square value leaps to a location from,
+  // and those behind a location along each slide direction, are tabulated,
+  // and the nearest piece behind is the nearest bit in the occupancy
+  //
+  // on larger boards, the map keeps, for each color and location, the number
+  // of leaps reaching it, and the set of directions along which a slide
+  // reaches it (there can be only one slide per color and direction), up to
+  // date with the command handlers: a move changes the attacks of the pieces
+  // on the changed locations, and the slides reaching them, which then go past
+  // them, or no longer do
+  //
+  // every capture a game can make of a piece that "is_under_attack()" is asked
+  // about must be declared; other captures (e.g., en passant, when only kings
+  // are asked about) needn't be
+  struct AttackMap { using this_t=AttackMap;
+    using attacks_t=
+      series<std::pair<series<Square>, series<Displacement>>>;
+    AttackMap(Piece2DGameData &d,
+              attacks_t leap_attacks, attacks_t slide_attacks);
+    Piece2DGameData const &d;
+    bool is_attacked(Board const &b, Location l, Color by) const;
+    // whether the piece at "l", of color "c", is sure not to be under attack
+    // after move "m" (made by "c"), without making it: "l" must not be under
+    // attack now, and "m" must not move its piece, nor vacate any location
+    // from which an enemy slide could go on to "l", nor set an enemy piece
+    bool stays_safe(Board const &b, Move const &m,
+                    Location l, Color c) const;
+  private:
+    using directions_t=u16; // a set of "directions", as bits
+    std::array<series<Displacement>, n_squares> leaps;
+    series<Displacement> directions; // those of all the slides
+    std::array<directions_t, n_squares> slides{};
+    // whether a slide of "by" along "directions[i]" reaches "l"
+    bool slide_reaches(Board const &b, Location l, index_t i, Color by) const;
+
+    // with bitboards:
+    using bitboard_t=Bitboards::bitboard_t;
+    static constexpr index_t max_locations=Bitboards::max_locations;
+    std::optional<Bitboards> own_bitboards; // if the game has none
+    Bitboards const *bitboards=nullptr;
+    std::array<series<Square>, 2> leapers; // by color
+    // by square value, and then by location bit:
+    std::array<std::vector<bitboard_t>, n_squares> leaps_to;
+    // by direction, and then by location bit; "growing" says whether the
+    // bits grow going away from the location:
+    std::vector<bitboard_t> behind;
+    std::vector<bool> behind_growing;
+    index_t behind_index(index_t i, Location l) const
+      { return i*max_locations+bitboards->bit(l); }
+    // on 8x8 boards, when every slide is a rook or a bishop, the square
+    // values sliding like each (see "SlideAttacks::Slider"), by color
+    SlideAttacks const *slide_tables=nullptr;
+    std::array<std::array<series<Square>, 2>, 2> table_sliders;
+    // the nearest of the pieces behind location "l", along "directions[i]",
+    // if any
+    bool nearest_behind(Board const &b, Location l, index_t i,
+                        Square &s) const;
+
+    // otherwise, by color and relative cell index (see "cell_index()"):
+    index_t const n_cells;
+    std::optional<Addressing<Kind::cache, Straight<u16>, u8>> leaps_in;
+    std::optional<Addressing<Kind::cache, Straight<u16>, directions_t>>
+      slides_in;
+    u16 cell_index(Color c, index_t cell) const
+      { return u16(index_t(c)*n_cells+cell); }
+    u16 cell_index(Color c, Location l) const
+      { return cell_index(c, d.squares.relative_cell_index(l)); }
+    // add ("on") or remove the attacks of square "s" at location "l"; "S",
+    // "L" and "T" are the accesses to "squares", "leaps_in" and "slides_in",
+    // in a board, or in the state and the cache
+    template <typename S, typename L, typename T>
+    void attack(S const &squares_a, L leaps_in_a, T slides_in_a,
+                Location l, Square s, bool on) const;
+    // the same, for the slide of color "c" along "directions[i]" from "l"
+    template <typename S, typename T>
+    void slide(S const &squares_a, T slides_in_a,
+               Color c, Location l, index_t i, bool on) const;
+    // set location "l" to "new_s", updating the attacks
+    void change(Board &b, Location l, Square new_s) const;
+    void set_cache(Data<Kind::cache> &cache,
+                   Data<Kind::state> const &state) const;
+    void move_handler(Board &b, Location from, Location to) const;
+    void capture_handler(Board &b, Location captured) const;
+    void set_handler(Board &b, Location l, Square new_s) const;
+  };
+
   // a base class to group moves, that already includes or abbreviates some of
   // the most usual features
   struct Move_base {
@@ -607,7 +953,8 @@ namespace sxako::piece_2d_game {
     SquareCount const &square_count;
     series<Square> const white_royal_squares, black_royal_squares;
   private:
-    void outcome_filter(Rules::Outcome &o, Board const &b) const;
+    void outcome_filter(Rules::Outcome &o, Board const &b,
+                        LazyLegalMoves &) const;
   };
 
   struct LoseIfNoLegalMove { using this_t=LoseIfNoLegalMove;
@@ -616,7 +963,8 @@ namespace sxako::piece_2d_game {
     // generator:
     PerSquareLegalMovesFilter const &per_square;
   private:
-    void outcome_filter(Rules::Outcome &o, Board const &b) const;
+    void outcome_filter(Rules::Outcome &o, Board const &,
+                        LazyLegalMoves &legal_moves) const;
   };
 
   struct ForceCaptureIfPossible { using this_t=ForceCaptureIfPossible;
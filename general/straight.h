@@ -3,6 +3,7 @@
 
 #include "grid.h"
 #include <map>
+#include <limits>
 
 namespace sxako {
 
@@ -48,6 +49,25 @@ namespace sxako {
   //     P_i = \product_{j=1}^{i-1} s_j
   //
   //     Z = - \sum{i=0}^{d-1} ( P_i m_i )
+  //
+  // When not all the coordinates in the range are board cells, "r_0" is then
+  // mapped to a compact index (skipping the non-board cells) through a lookup
+  // table.  When they all are (the "dense" case, e.g. the "all<coord_t>()"
+  // default), the compact index is "r_0" itself, and both the lookup and the
+  // check for board cells are skipped.
+  //
+  // Optionally, the storage can be padded (mailbox-style) with "padding"
+  // extra cells on each side of each dimension, as if "m_n" were
+  // "m_n-padding" and "s_n" were "s_n+2*padding"; the non-board cells (the
+  // padding, and the holes in the range) are then stored too, and "r_0" is
+  // always the relative cell index; the non-board cells are listed in
+  // "off_board_indices", so that they can be filled with a sentinel value
+  // (see "DataSpec<kind>::set_initial()"), and "index_step()" gives the
+  // change in index for a displacement, so that a piece can move along a
+  // line with linear indices, with no coordinate arithmetic, and stop on the
+  // sentinel (the displacement must not be longer than "padding" in any
+  // dimension, so that it can't jump over the padding).
+  struct padding_t { index_t cells; };
   template <index_t dim, typename CoordT=def_coord_t<dim>>
   class StraightIndexing {
   public:
@@ -59,14 +79,22 @@ namespace sxako {
     StraightIndexing(T const &range_)
       : StraightIndexing(all<coord_t>(), range_) { }
     template <typename T>
-      StraightIndexing(contains_t<coord_t> const &board_cells, T const &range_)
-      : range(range_), size(range_to_size(range)),
-        details(size, range, board_cells),
+    StraightIndexing(contains_t<coord_t> const &board_cells, T const &range_)
+      : StraightIndexing(padding_t{0}, board_cells, range_) { }
+    template <typename T>
+    StraightIndexing(padding_t padding, T const &range_)
+      : StraightIndexing(padding, all<coord_t>(), range_) { }
+    template <typename T>
+    StraightIndexing(padding_t padding,
+                     contains_t<coord_t> const &board_cells, T const &range_)
+      : range(range_), size(range_to_size(range)), padding(padding.cells),
+        details(size, range, board_cells, padding.cells),
         cell_storage(details.cell_storage),
         enumerated_coords(enumerated_coords_from_range(range)),
         all_enumerated_coords(details.all_enumerated_coords),
         reverse_all_enumerated_coords(revert(all_enumerated_coords)),
-        all_enumerated_displayed_coords(cartesian(enumerated_coords)) { }
+        all_enumerated_displayed_coords(cartesian(enumerated_coords)),
+        off_board_indices(details.off_board_indices) { }
     template <typename... T, typename... U>
     StraightIndexing(std::pair<T, U> const &...p)
       : StraightIndexing(std::make_tuple(p...)) { }
@@ -74,40 +102,80 @@ namespace sxako {
     StraightIndexing(contains_t<coord_t> const &board_cells,
                      std::pair<T, U> const &...p)
       : StraightIndexing(board_cells, std::make_tuple(p...)) { }
+    template <typename... T, typename... U>
+    StraightIndexing(padding_t padding, std::pair<T, U> const &...p)
+      : StraightIndexing(padding, std::make_tuple(p...)) { }
+    template <typename... T, typename... U>
+    StraightIndexing(padding_t padding,
+                     contains_t<coord_t> const &board_cells,
+                     std::pair<T, U> const &...p)
+      : StraightIndexing(padding, board_cells, std::make_tuple(p...)) { }
 
     coord_range_t const range;
     size_t const size;
+    index_t const padding;
   private:
     struct Details {
       Details(size_t const &size, coord_range_t const &range,
-              contains_t<coord_t> board_cells) {
+              contains_t<coord_t> board_cells, index_t padding) {
         auto m=tuple_to_array<s_index_t>(tuple_first(range));
         P[0]=1;
         for (index_t i=1; i<dim; ++i)
-          P[i]=P[i-1]*size[i-1];
+          P[i]=P[i-1]*s_index_t(size[i-1]+2*padding);
         Z=0;
         for (index_t i=0; i<dim; ++i)
-          Z-=P[i]*m[i];
+          Z-=P[i]*(m[i]-s_index_t(padding));
 
         cell_storage=0;
+        if (padding)
+          compact_indices.resize(
+            index_t(P[dim-1])*(size[dim-1]+2*padding), invalid_index);
+        all_board=true;
+        direct=true;
         for (coord_t c: r_cartesian(enumerated_coords_from_range(range))) {
           index_t i=noncompact_relative_cell_index(c);
           compact_indices.resize(std::max(compact_indices.size(), i+1));
           if (board_cells(c)) {
             all_enumerated_coords.push_back(c);
-            compact_indices[i]=cell_storage++;
+            compact_indices[i]=padding ? i : cell_storage++;
+            direct=direct and compact_indices[i]==i;
           }
-          else
+          else {
             compact_indices[i]=invalid_index;
+            all_board=false;
+          }
+        }
+        if (padding) {
+          cell_storage=compact_indices.size();
+          for (index_t i=0; i<cell_storage; ++i)
+            if (compact_indices[i]==invalid_index)
+              off_board_indices.push_back(i);
         }
       }
       index_t relative_cell_index(coord_t const &c) const {
         assert(noncompact_relative_cell_index(c)<compact_indices.size());
-        return compact_indices[noncompact_relative_cell_index(c)];
+        return
+          direct
+          ? noncompact_relative_cell_index(c)
+          : compact_indices[noncompact_relative_cell_index(c)];
+      }
+      bool is_board_cell(coord_t const &c) const {
+        return
+          all_board
+          or compact_indices[noncompact_relative_cell_index(c)]
+             not_eq invalid_index;
       }
+      s_index_t index_step(coord_t const &delta) const
+        { return s_index_t(noncompact_relative_cell_index_impl<0>(delta))-Z; }
 
       index_t cell_storage;
       std::vector<coord_t> all_enumerated_coords;
+      std::vector<index_t> off_board_indices;
+      // every coordinate in the range is a board cell:
+      bool all_board;
+      // the compact index of a board cell is its noncompact index (always,
+      // with padding):
+      bool direct;
     private:
       index_t noncompact_relative_cell_index(coord_t const &c) const
         { return noncompact_relative_cell_index_impl<0>(c); }
@@ -134,12 +202,15 @@ namespace sxako {
     std::vector<coord_t> const
       all_enumerated_coords, reverse_all_enumerated_coords,
       all_enumerated_displayed_coords;
-
-    bool contains(coord_t const &c) const {
-      return
-        range_contains(c)
-        and relative_cell_index(c) not_eq invalid_index;
-    }
+    std::vector<index_t> const off_board_indices; // only with padding
+
+    bool contains(coord_t const &c) const
+      { return range_contains(c) and details.is_board_cell(c); }
+    // with padding, the change in relative cell index for a displacement
+    // (a "delta_t<coord_t>")
+    template <typename D>
+    s_index_t index_step(D const &delta) const
+      { return details.index_step(coord_t()+delta); }
   protected:
     index_t relative_cell_index(coord_t const &c) const {
       assert(range_contains(c));
@@ -1,10 +1,10 @@
 #include "think.h"
+#include "monte_carlo.h"
 #include "stats.h"
 #include <map>
 #include <unordered_map>
 #include <limits>
 #include <memory>
-#include <iostream> // FIXME
 
 using namespace std;
 
@@ -99,6 +99,7 @@ namespace sxako {
       {"wf", read(window.factor)},
       {"wn", read(window.max_n)},
       {"l", read(level)},
+      {"tl", read(timed_level)},
       {"bd", read(boldness.depth)},
       {"bs", read(boldness.score)},
       {"be", read(boldness.emboldening)},
@@ -111,6 +112,29 @@ namespace sxako {
        }},
       {"rd", read(random.deviation)},
       {"rm", read(random.max_factor)},
+      {"mc", read(monte_carlo.exploration)},
+      {"mn", read(monte_carlo.max_nodes)},
+      {"mt",
+       [this](string s) {
+          monte_carlo.threads=from_text<unsigned>(s);
+          if (not monte_carlo.threads)
+            throw invalid_argument("wrong params (no threads)");
+       }},
+      {"mg", read(monte_carlo.graph)},
+      {"mw", read(monte_carlo.widening)},
+      {"ma", read(monte_carlo.widening_exponent)},
+      {"pl", read(monte_carlo.playout_length)},
+      {"ps", read(monte_carlo.playout_scale)},
+      {"ms", read(monte_carlo.solver)},
+      {"mr", read(monte_carlo.rave)},
+      {"mp",
+       [this](string s) {
+          using parallel_t=monte_carlo_t::parallel_t;
+          if (s=="t") monte_carlo.parallel=parallel_t::tree;
+          else if (s=="r") monte_carlo.parallel=parallel_t::root;
+          else throw invalid_argument(
+                       "wrong params (unknown parallelisation \""+s+"\")");
+       }},
     };
     params_t params=parse(params_s);
     for (auto p: params)
@@ -130,6 +154,20 @@ namespace sxako {
       inf_score=beyond_max_score*inf_level;
     score_t nan_score=numeric_limits<score_t>::signaling_NaN();
 
+    // time management constants (see "ComputerPlayer::time_budget()" and
+    // "ComputerPlayer::get_move_tree_search()")
+    unsigned const
+      sudden_death_moves_to_go=50, // expected at the start of the game...
+      min_moves_to_go=20;          // ...and never less than this
+    seconds_t const
+      increment_fraction=.8, // how much of the increment we spend right away
+      hard_factor=4.,
+      max_remaining_fraction=.4,
+      start_level_soft_fraction=.5;
+    int const max_timed_level=64;
+    score_t const unstable_score_change=.25;
+    seconds_t const unstable_soft_factor=1.5;
+
     score_t flip(score_t s) {
       if (s<=beyond_max_score)
         return -s;
@@ -137,26 +175,84 @@ namespace sxako {
         return s<0 ? -(s+beyond_max_score) : -(s-beyond_max_score);
     }
 
-    // evaluate outcome from the point of view of the player who has just played
-    score_t eval_outcome(Rules::Outcome o) {
-      switch(o) {
-      case Rules::Outcome::draw:
-        return 0.;
-      case Rules::Outcome::last_move_won:
-        return +1.;
-      case Rules::Outcome::last_move_lost:
-        return -1.;
-      default:
-        return nan_score;
-      }
+  }
+
+  score_t eval_outcome(Rules::Outcome o) {
+    switch(o) {
+    case Rules::Outcome::draw:
+      return 0.;
+    case Rules::Outcome::last_move_won:
+      return +1.;
+    case Rules::Outcome::last_move_lost:
+      return -1.;
+    default:
+      return nan_score;
     }
+  }
 
-    enum class memo_flag { exact, lower, upper };
-    using memoization_t=
-      map<unsigned, unordered_map<string, pair<MoveScore, memo_flag>>>;
+  namespace {
+
+    // a memoised search result holds the best move found and the bounds known
+    // for the score (equal bounds make it exact); the bounds stay valid
+    // whatever the window of later searches, so they're kept across windows
+    // and refined every time the same board is searched again at the same
+    // level
+    //
+    // besides, the best move last found for each board, whatever the level, is
+    // kept as the "hash move", to be tried first whenever the board is
+    // searched again (e.g., one level deeper in the next iteration of
+    // iterative deepening)
+    //
+    // the memo is keyed by board, but a repetition is a draw only on the path
+    // that repeats: a score that depends on one (found on the board itself or
+    // below it) isn't stored, and a repeated board isn't looked up; so the
+    // repetition draws met are counted
+    struct memo_entry_t {
+      MoveScore best;
+      score_t lower=-inf_score, upper=+inf_score;
+    };
+    struct memoization_t {
+      map<unsigned, unordered_map<string, memo_entry_t>> levels;
+      unordered_map<string, Move> hash_moves;
+      unsigned long n_repetitions=0;
+    };
     using bottom_memoization_t=unordered_map<string, score_t>;
 
-    using random_increment_f=function<score_t (string id)>;
+    // the random increment for a board, from its "id_hash()"
+    using random_increment_f=function<score_t (u64 id_hash)>;
+
+    // thrown from inside the search when its deadline has passed
+    struct out_of_time { };
+
+    // triangular table for the principal variation: row "ply" holds the best
+    // line found from the board being searched at that ply, so that row 0
+    // holds the principal variation; when a board gets a new best move, its
+    // row becomes that move followed by the row of the child just searched
+    class PVTable {
+    public:
+      void clear(unsigned ply) { row(ply).clear(); }
+      void set(unsigned ply, Move const &m) {
+        Moves const &next_line=row(ply+1); // first, since it may resize
+        Moves &line=row(ply);
+        line=next_line;
+        line.push_front(m);
+      }
+      Moves const &line(unsigned ply=0) { return row(ply); }
+    private:
+      Moves &row(unsigned ply) {
+        if (ply>=rows.size())
+          rows.resize(ply+1);
+        return rows[ply];
+      }
+      vector<Moves> rows;
+    };
+    // the principal variation of the previous search (e.g., the previous
+    // iteration of iterative deepening) seeds move ordering: while following
+    // it from the root, its move at each ply is searched first
+    struct pv_t {
+      PVTable table;
+      vector<Move> seed;
+    };
 
     // the best move considering level 1 is the one that gives you the highest
     // evaluation; the best move considering level n (with n>1) is the one that
@@ -172,7 +268,10 @@ namespace sxako {
     //
     // best_score(b, 0)=-eval(b)
     // best_score(b, n>0)=max(-best_score(b, n-1))
-    MoveScore find_best_move(Game const &g, Board const &b,
+    //
+    // "path" holds the positions that led to "b", "b" included; it's restored
+    // on return (but not when out of time)
+    MoveScore find_best_move(Game const &g, Board const &b, PositionPath &path,
                              score_t current_score,
                              evaluation_function_t eval,
                              int level,
@@ -181,7 +280,9 @@ namespace sxako {
                              AlgorithmParams const &p,
                              memoization_t &memo,
                              bottom_memoization_t &bottom_memo,
-                             random_increment_f const &random_increment) {
+                             random_increment_f const &random_increment,
+                             Deadline const &deadline,
+                             pv_t &pv, unsigned ply, bool on_seed_pv) {
 #define if_transposition                                                     \
       if (p.search==AlgorithmParams::search_t::pruning_and_transposition)
 #define if_pruning                                                           \
@@ -190,25 +291,65 @@ namespace sxako {
 
       assert(level>0); // at level==1 we don't recurse down; see below
 
-      /// score_t alpha_orig=alpha;
+      if (deadline.passed())
+        throw out_of_time();
+
+      pv.table.clear(ply);
+
       string b_id;
-      score_t alpha_orig=alpha;
+      // best move from an earlier search of this board, to be tried first:
+      Move hash_move;
 
+      auto const n_repetitions_before=memo.n_repetitions;
       if_transposition {
         b_id=b.id();
-        auto memo_it=memo[level].find(b_id);
-        if (memo_it not_eq memo[level].end()) {
-          // found=true;
-          auto move_score=memo_it->second.first;
-          switch (memo_it->second.second) {
-          case memo_flag::exact: return move_score;
-          case memo_flag::upper: beta=min(beta, move_score.score); break;
-          case memo_flag::lower: alpha=max(alpha, move_score.score); break;
+        if (g.repeated(b, path))
+          ++memo.n_repetitions; // a draw, whatever the memo says
+        else {
+          auto &memo_level=memo.levels[level];
+          auto memo_it=memo_level.find(b_id);
+          if (memo_it not_eq memo_level.end()) {
+            auto const &entry=memo_it->second;
+            if (entry.lower>=entry.upper or entry.lower>=beta
+                or entry.upper<=alpha) {
+              if (entry.best.move.size()) {
+                // the row below belongs to whatever was searched last there
+                pv.table.clear(ply+1);
+                pv.table.set(ply, entry.best.move);
+              }
+              return {entry.best.move,
+                      entry.upper<=alpha ? entry.upper : entry.lower};
+            }
+            // the bounds narrow the window:
+            alpha=max(alpha, entry.lower);
+            beta=min(beta, entry.upper);
           }
-          if (alpha>=beta)
-            return move_score;
+          if (level>1) {
+            auto hash_move_it=memo.hash_moves.find(b_id);
+            if (hash_move_it not_eq memo.hash_moves.end())
+              hash_move=hash_move_it->second;
+          }
+        }
+      }
+      // the seeding principal variation takes precedence over the hash move;
+      // but, unlike the hash move (kept for this very board), it was found for
+      // some other search, so it's only followed if legal here, which means
+      // generating the legal moves beforehand
+      Moves all_moves;
+      Rules::Outcome outcome=Rules::Outcome::playing;
+      bool moves_generated=false;
+      Move const *pv_move=nullptr;
+      if (on_seed_pv and ply<pv.seed.size() and level>1) {
+        outcome=g.outcome_and_legal_moves(b, all_moves, path);
+        moves_generated=true;
+        if (find(all_moves.begin(), all_moves.end(), pv.seed[ply])
+            not_eq all_moves.end()) {
+          pv_move=&pv.seed[ply];
+          hash_move=*pv_move;
         }
       }
+      // the window actually searched:
+      score_t const alpha_orig=alpha, beta_orig=beta;
 
       MoveScore
         current_best{Move(), -inf_score},
@@ -223,83 +364,141 @@ namespace sxako {
         current_best.score=current_score;
       }
 
-      auto outcome=g.outcome(b);
-      if (outcome not_eq Rules::Outcome::playing)
-        current_best.score=flip(eval_outcome(outcome)*inf_score);
-      else {
-        Moves all_moves=g.legal_moves(b);
-        if (all_moves.empty())
-          throw logic_error("can't move");
-
-        Board nb(g.rules.data_spec);
-        string nb_id;
+      Board nb(g.rules.data_spec);
+      string nb_id;
 
-        // all moves-and-score's, except unbold if already in the bold moves
-        // levels:
-        list<MoveScore> all_moves_with_scores;
-        for (auto m: all_moves) {
+      // quick evaluation of a move, for ordering and boldness
+      auto quick_score=
+        [&](Move const &m) {
           nb=b;
           g.move(nb, m);
-          nb_id=nb.id();
           score_t move_score;
           if_transposition {
+            nb_id=nb.id();
             auto memo_it=bottom_memo.find(nb_id);
             if (memo_it not_eq bottom_memo.end())
               move_score=flip(memo_it->second);
             else {
-              move_score=eval(nb)+random_increment(nb_id);
+              move_score=eval(nb)+random_increment(nb.id_hash());
               ++n_quick_evaluations;
               bottom_memo[nb_id]=flip(move_score);
             }
           }
           else {
-            move_score=eval(nb)+random_increment(nb_id);
+            move_score=eval(nb)+random_increment(nb.id_hash());
             ++n_quick_evaluations;
           }
-          if (move_score>=bold_score_threshold)
+          return move_score;
+        };
+      // search a move one level down; return "true" if there's a cutoff
+      auto search_deeper=
+        [&](MoveScore const &ms) {
+          nb=b;
+          g.move(nb, ms.move);
+          path.push_back(nb.id_hash());
+          score_t ns=
+            flip(find_best_move(g, nb, path, flip(ms.score), eval,
+                                level-1, boldness,
+                                -beta, -alpha,
+                                p, memo, bottom_memo, random_increment,
+                                deadline,
+                                pv, ply+1, pv_move and ms.move==*pv_move)
+                 .score);
+          path.pop_back();
+
+          if (ns>current_best.score) {
+            current_best={ms.move, ns};
+            pv.table.set(ply, ms.move);
+          }
+
+          if_pruning {
+            alpha=max(current_best.score, alpha);
+            if (alpha>=beta)
+              return true;
+          }
+          return false;
+        };
+
+      // the hash move (if bold enough) is searched before generating and
+      // evaluating the other moves, which may be unnecessary after a cutoff
+      MoveScore hash_move_score{hash_move, -inf_score};
+      bool hash_move_searched=false, cutoff=false;
+      if (not moves_generated) {
+        if (hash_move.size())
+          outcome=g.outcome(b, path);
+        else {
+          outcome=g.outcome_and_legal_moves(b, all_moves, path);
+          moves_generated=true;
+        }
+      }
+      if (hash_move.size() and outcome==Rules::Outcome::playing) {
+        hash_move_score.score=quick_score(hash_move);
+        if (hash_move_score.score>=bold_score_threshold) {
+          hash_move_searched=true;
+          cutoff=search_deeper(hash_move_score);
+        }
+        // the remaining moves are only generated now, still along with the
+        // outcome (already known to be "playing")
+        if (not cutoff and not moves_generated) {
+          outcome=g.outcome_and_legal_moves(b, all_moves, path);
+          moves_generated=true;
+        }
+      }
+
+      if (outcome not_eq Rules::Outcome::playing)
+        current_best.score=flip(eval_outcome(outcome)*inf_score);
+      else if (not cutoff) {
+        if (all_moves.empty())
+          throw logic_error("can't move");
+
+        // all moves-and-score's, except unbold if already in the bold moves
+        // levels, and except the hash move if already searched:
+        list<MoveScore> all_moves_with_scores;
+        for (auto m: all_moves) {
+          score_t move_score=
+            m==hash_move ? hash_move_score.score : quick_score(m);
+          if (move_score>=bold_score_threshold
+              and not (hash_move_searched and m==hash_move))
             all_moves_with_scores.push_back({m, move_score});
           if (move_score>=current_best_immediate.score)
             current_best_immediate={m, move_score};
         }
 
-        if (level==1 or all_moves_with_scores.empty())
+        if (level==1
+            or (all_moves_with_scores.empty() and not hash_move_searched)) {
           // we've already got the best move:
           current_best=current_best_immediate;
+          pv.table.clear(ply+1);
+          pv.table.set(ply, current_best.move);
+        }
         else {
           all_moves_with_scores.sort(
             [](MoveScore const &a, MoveScore const &b)
               { return a.score>b.score; }); // descending scores
-          for (auto ms: all_moves_with_scores) { // from highest to lowest score
-            Move m=ms.move;
-            nb=b;
-            g.move(nb, m);
-            score_t ns=
-              flip(find_best_move(g, nb, flip(ms.score), eval,
-                                  level-1, boldness,
-                                  -beta, -alpha,
-                                  p, memo, bottom_memo, random_increment)
-                   .score);
-
-            if (ns>current_best.score)
-              current_best={m, ns};
-
-            if_pruning {
-              alpha=max(current_best.score, alpha);
-              if (alpha>=beta)
-                break;
-            }
-          }
+          for (auto ms: all_moves_with_scores) // from highest to lowest score
+            if (search_deeper(ms))
+              break;
         }
       }
 
       if_transposition {
-        memo_flag mf=
-          current_best.score<=alpha_orig
-          ? memo_flag::upper
-          : current_best.score>=beta
-          ? memo_flag::lower
-          : memo_flag::exact;
-        memo[level][b_id]={current_best, mf};
+        if (memo.n_repetitions==n_repetitions_before) {
+          score_t const score=current_best.score;
+          score_t
+            lower=score<=alpha_orig ? -inf_score : score,
+            upper=score>=beta_orig ? +inf_score : score;
+          auto &entry=memo.levels[level][b_id];
+          entry.best=current_best;
+          entry.lower=max(entry.lower, lower);
+          entry.upper=min(entry.upper, upper);
+          if (entry.lower>entry.upper) { // search instability: the latest
+            entry.lower=lower;
+            entry.upper=upper;
+          }
+        }
+        // the move is still worth trying first, whatever the path
+        if (current_best.move.size())
+          memo.hash_moves[b_id]=current_best.move;
       }
 
       return current_best;
@@ -308,131 +507,19 @@ namespace sxako {
 #undef if_transposition
     }
 
-    using random_number_t=function<size_t (size_t)>;
-
-    score_t play_random_to_the_end(Game const &g, Board &b,
-                                   random_number_t const &random_number,
-                                   size_t &moves_left,
-                                   int factor=+1) {
-      auto outcome=g.outcome(b);
-      if (outcome not_eq Rules::Outcome::playing)
-        return factor*eval_outcome(outcome);
-
-      if (moves_left)
-        --moves_left;
-      Moves all_moves=g.legal_moves(b);
-      Move m=*next(all_moves.begin(), random_number(all_moves.size()));
-      g.move(b, m);
-      return play_random_to_the_end(g, b, random_number, moves_left, -factor);
-    }
-
-    namespace MonteCarlo {
-
-      struct move_tree_node_t {
-        Move const move;
-        Board const resulting_board;
-        move_tree_node_t *const parent=nullptr;
-        score_t total_score=0.;
-        size_t n_simulations=0;
-        shared_ptr<vector<move_tree_node_t>> children=nullptr;
-        size_t n_unexpanded_children=0;
-      };
-
-    }
-
-    void print_tree(Game const &g,
-                    MonteCarlo::move_tree_node_t const &n, int level=0) {
-      if (n.n_simulations) {
-        for (auto i: loop(level))
-          cout << "  ";
-        cout << " " << g.write_move(n.move) << ": "
-             << n.total_score << "/" << n.n_simulations << " "
-             << n.total_score/n.n_simulations << endl;
-        if (n.children)
-          for (auto c: *n.children)
-            print_tree(g, c, level+1);
-      }
-    }
-
-    template <typename URGB>
-    MoveScore monte_carlo_best_move(Game const &g,
-                                    random_number_t const &random_number,
-                                    URGB &&random,
-                                    size_t n_moves) {
-      using namespace MonteCarlo;
-      move_tree_node_t root{Move(), g.board()};
-      size_t moves_left=n_moves;
-      while (moves_left) {
-        /// selection
-        move_tree_node_t *node=&root;
-        // wander down the tree at random
-        while (node->children and not node->n_unexpanded_children)
-          node=&(*node->children)[random_number(node->children->size())];
-        /// expansion
-        auto outcome=g.outcome(node->resulting_board);
-        score_t score;
-        if (outcome not_eq Rules::Outcome::playing)
-          score=eval_outcome(outcome);
-        else {
-          if (not node->children) {
-            Moves all_moves=g.legal_moves(node->resulting_board);
-            assert(not all_moves.empty()); // because "outcome==playing"
-            // shuffle moves
-            vector<Move> // a list can't be shuffled: random access
-              all_moves_shuffled(all_moves.begin(), all_moves.end());
-            shuffle(all_moves_shuffled.begin(), all_moves_shuffled.end(),
-                    random);
-            // create all children
-            node->n_unexpanded_children=all_moves_shuffled.size();
-            node->children=make_shared<vector<move_tree_node_t>>();
-            node->children->reserve(node->n_unexpanded_children);
-            for (Move const &m: all_moves_shuffled) {
-              Board b=node->resulting_board;
-              // FIXME: we could evaluate outcome here for each child
-              g.move(b, m);
-              node->children->push_back({m, b, node});
-            }
-          }
-          // visit first unexplored child (from the end because it's easier):
-          assert(node->n_unexpanded_children);
-          node=&(*node->children)[--node->n_unexpanded_children];
-          /// simulation
-          Board b_play=node->resulting_board;
-          score=play_random_to_the_end(g, b_play, random_number, moves_left);
-        }
-        /// backpropagation
-        int factor=1;
-        while (node) {
-          node->total_score+=factor*score;
-          ++node->n_simulations;
-          node=node->parent;
-          factor=-factor;
-        }
-      }
-
-      // best move
-      score_t max=numeric_limits<score_t>::lowest();
-      Move best;
-      for (auto mns: *root.children) {
-        auto s=mns.total_score/mns.n_simulations;
-        if (s>max) {
-          max=s;
-          best=mns.move;
-        }
-      }
-      // debugging info:
-      print_tree(g, root);
-
-      return {best, max};
-    }
-
   }
 
   bool operator==(const AlgorithmParams &a, const AlgorithmParams &b) {
 #define attributes(p)                                                    \
     p.search, p.window.init, p.window.factor, p.window.max_n,            \
-    p.level, p.boldness.depth, p.boldness.score, p.boldness.emboldening, \
-    p.random.seed, p.random.deviation, p.random.max_factor
+    p.level, p.timed_level,                                              \
+    p.boldness.depth, p.boldness.score, p.boldness.emboldening,          \
+    p.random.seed, p.random.deviation, p.random.max_factor,             \
+    p.monte_carlo.exploration, p.monte_carlo.max_nodes,                 \
+    p.monte_carlo.threads, p.monte_carlo.parallel, p.monte_carlo.graph,  \
+    p.monte_carlo.widening, p.monte_carlo.widening_exponent,             \
+    p.monte_carlo.playout_length, p.monte_carlo.playout_scale,          \
+    p.monte_carlo.solver, p.monte_carlo.rave
     return make_tuple(attributes(a))==make_tuple(attributes(b));
 #undef attributes
   }
@@ -448,8 +535,7 @@ namespace sxako {
     normal_distribution<score_t> distr(0., 1.);
     auto random_seed=random(); // a new xor-seed for the whole move computation
     auto random_increment=
-      [this, random_seed, &distr](string id) {
-        auto id_hash=hash<string>()(id);
+      [this, random_seed, &distr](u64 id_hash) {
         random_generator_t this_id_random(random_seed xor id_hash);
         distr.reset(); // otherwise, the random depends on "distr" history
         while (true) {
@@ -459,44 +545,122 @@ namespace sxako {
         }
       };
 
-    score_t
-      alpha=last_best_score-algo_params.window.init/2.,
-      beta=last_best_score+algo_params.window.init/2.;
-    MoveScore result;
+    // the memoisation is kept for the whole move computation, since its
+    // entries are valid whatever the window:
+    memoization_t memo;
     bottom_memoization_t bottom_memo;
-    for (unsigned window=0; window<=algo_params.window.max_n; ++window) {
-      // the memoisation must restart for each window, since the window affects
-      // the computed scores (not so for the bottom memoisation):
-      memoization_t memo;
-      if (window==algo_params.window.max_n) {
-        alpha=-inf_score;
-        beta=+inf_score;
+    pv_t pv;
+    // windowed search at a given level, with the window centred on "guess"
+    auto search=
+      [&](int level, score_t guess, Deadline const &deadline) {
+        score_t
+          alpha=guess-algo_params.window.init/2.,
+          beta=guess+algo_params.window.init/2.;
+        MoveScore result;
+        for (unsigned window=0; window<=algo_params.window.max_n; ++window) {
+          if (window==algo_params.window.max_n) {
+            alpha=-inf_score;
+            beta=+inf_score;
+          }
+          PositionPath path=g.path();
+          result=find_best_move(g, g.board(), path, 0., eval,
+                                level+algo_params.boldness.depth,
+                                algo_params.boldness,
+                                alpha, beta,
+                                algo_params, memo, bottom_memo,
+                                random_increment, deadline,
+                                pv, 0, true);
+          result.pv=pv.table.line();
+
+          if (result.score>=beta)
+            beta=alpha+algo_params.window.factor*(beta-alpha);
+          else if (result.score<=alpha)
+            alpha=beta+algo_params.window.factor*(alpha-beta);
+          else
+            break;
+        }
+        return result;
+      };
+
+    MoveScore result;
+    if (not clock)
+      result=search(algo_params.level, last_best_score, Deadline());
+    else {
+      // iterative deepening: each level starts with the previous level's
+      // score as a guess; the first level always completes, and then we go
+      // deeper while we're well within the soft limit; an unstable score
+      // (the best move or its score changing from one level to the next)
+      // earns us more time, up to the hard limit
+      auto budget=time_budget();
+      Deadline hard_deadline(budget.hard);
+      seconds_t soft=budget.soft;
+      int const max_level=
+        algo_params.timed_level>0
+        ? min(algo_params.timed_level, max_timed_level)
+        : max_timed_level;
+      result=search(1, last_best_score, Deadline());
+      for (int level=2;
+           level<=max_level
+             and abs(result.score)<beyond_max_score // outcome not yet known
+             and hard_deadline.elapsed()<soft*start_level_soft_fraction;
+           ++level) {
+        MoveScore level_result;
+        pv.seed.assign(result.pv.begin(), result.pv.end());
+        try {
+          level_result=search(level, result.score, hard_deadline);
+        }
+        catch (out_of_time const &) {
+          break;
+        }
+        if (not (level_result.move==result.move)
+            or abs(level_result.score-result.score)>unstable_score_change)
+          soft=min(soft*unstable_soft_factor, budget.hard);
+        result=level_result;
       }
-      result=find_best_move(g, g.board(), 0., eval,
-                            algo_params.level+algo_params.boldness.depth,
-                            algo_params.boldness,
-                            alpha, beta,
-                            algo_params, memo, bottom_memo, random_increment);
-
-      for (auto const &m: memo)
-        max_transposition_table_size[m.first]=
-          max(max_transposition_table_size[m.first], m.second.size());
-
-      if (result.score>=beta)
-        beta=alpha+algo_params.window.factor*(beta-alpha);
-      else if (result.score<=alpha)
-        alpha=beta+algo_params.window.factor*(alpha-beta);
-      else
-        break;
     }
+    for (auto const &m: memo.levels)
+      max_transposition_table_size[m.first]=
+        max(max_transposition_table_size[m.first], m.second.size());
     last_best_score=result.score;
     return result;
   }
 
+  ComputerPlayer::time_budget_t ComputerPlayer::time_budget() const {
+    seconds_t remaining=max(clock->remaining(), 0.);
+    unsigned moves_to_go=clock->moves_to_go();
+    if (not moves_to_go) // sudden death: guess how long the game will last
+      moves_to_go=
+        sudden_death_moves_to_go
+        -min(clock->moves_played(), sudden_death_moves_to_go-min_moves_to_go);
+    seconds_t base=
+      remaining/moves_to_go+increment_fraction*clock->time_control.increment;
+    seconds_t hard=min(base*hard_factor, remaining*max_remaining_fraction);
+    return {min(base, hard), hard};
+  }
+
   MoveScore ComputerPlayer::get_move_monte_carlo(Game const &g) {
-    auto random_number=[this](size_t n)
-      { return uniform_int_distribution<size_t>(0, n-1)(random); };
-    return monte_carlo_best_move(g, random_number, random, algo_params.level);
+    // the last search's tree is reused if it reached the current board (our
+    // move, and the opponent's reply), from there down; otherwise, we start
+    // afresh
+    if (monte_carlo_tree) {
+      auto i=monte_carlo_tree->find(g, 2);
+      monte_carlo_tree=
+        i==MonteCarloTree::none
+        ? nullptr
+        : make_shared<MonteCarloTree>(*monte_carlo_tree, i,
+                                      g.board(), g.path());
+    }
+    if (not monte_carlo_tree)
+      monte_carlo_tree=
+        make_shared<MonteCarloTree>(g.board(), g.path(),
+                                    algo_params.monte_carlo.max_nodes);
+    if (not clock)
+      return monte_carlo_best_move(g, *monte_carlo_tree, eval, algo_params,
+                                   random, algo_params.level, Deadline());
+    else // on time, the soft limit replaces the playout moves budget
+      return monte_carlo_best_move(g, *monte_carlo_tree, eval, algo_params,
+                                   random, numeric_limits<size_t>::max(),
+                                   Deadline(time_budget().soft));
   }
 
   MoveScore ComputerPlayer::get_move(Game const &g) {
@@ -2,7 +2,9 @@
 #define SXAKO_THINK_HEADER_
 
 #include "board.h"
+#include "clock.h"
 #include <map>
+#include <memory>
 #include <random>
 
 namespace sxako {
@@ -12,8 +14,14 @@ namespace sxako {
   struct MoveScore { // group together a move and its evaluated score
     Move move;
     score_t score;
+    Moves pv={}; // principal variation, starting with "move" (if known)
+    std::string report={}; // search statistics, one line each (if any)
   };
 
+  // evaluate a finished game's outcome from the point of view of the player
+  // who has just played: +1 if won, 0 if drawn, -1 if lost
+  score_t eval_outcome(Rules::Outcome o);
+
   // the evaluation function gives a score to a board, from the point of view
   // of the player who has just played
   using evaluation_function_t=std::function<score_t (Board const &)>;
@@ -71,6 +79,8 @@ namespace sxako {
     virtual ~Player()=default;
     std::string const name;
     virtual MoveScore get_move(Game const &g)=0;
+    // the player's clock, if playing on time (see "match_up()")
+    std::shared_ptr<Clock> clock;
   };
 
   using random_generator_t=std::minstd_rand;
@@ -84,13 +94,39 @@ namespace sxako {
     //   wi: initial search window width (window.init)
     //   wf: window widening factor (window.factor)
     //   wn: number of windowed searches before going windoless (window.max_n)
-    //   l: depth of thinking (level)
+    //   l: depth of thinking (level); for monte-carlo, number of playout
+    //     moves
+    //   tl: maximum depth of thinking when playing on time (timed_level); 0
+    //     for no maximum but the time
     //   bd: number of additional bold moves (boldness.depth)
     //   bs: additional boldness score (boldness.score)
     //   be: additional per-level emboldening (boldness.emboldening)
     //   rs: seed for random number generation (random.seed)
     //   rd: standard deviation of random evaluation (random.deviation)
     //   rm: maximum random deviation factor (random.max_factor)
+    //   mc: monte-carlo UCT exploration constant (monte_carlo.exploration)
+    //   mn: monte-carlo node budget (monte_carlo.max_nodes)
+    //   mt: monte-carlo threads (monte_carlo.threads)
+    //   mp: [tr] monte-carlo parallelisation, with several threads
+    //     (monte_carlo.parallel): tree (default), one tree shared by all
+    //     threads, or root, one tree per thread, added up at the root
+    //   mg: [01] monte-carlo graph, merging transpositions (monte_carlo.graph)
+    //   mw: monte-carlo progressive widening: only the first
+    //     "ceil(widening*n^exponent)" moves of a node visited "n" times are
+    //     considered; 0 to consider all of them (monte_carlo.widening)
+    //   ma: monte-carlo progressive widening exponent
+    //     (monte_carlo.widening_exponent)
+    //   pl: monte-carlo playout length, after which the evaluation function
+    //     is used; 0 for playouts to the end of the game
+    //     (monte_carlo.playout_length)
+    //   ps: monte-carlo scale for the evaluation at the end of a playout,
+    //     which is squashed by "tanh(evaluation/scale)"
+    //     (monte_carlo.playout_scale)
+    //   ms: [01] monte-carlo solver, propagating proven wins and losses
+    //     (monte_carlo.solver); ignored for a graph
+    //   mr: monte-carlo RAVE equivalence: number of simulations of a node
+    //     at which its all-moves-as-first statistics weigh as much as its
+    //     own ones; 0 for no RAVE (monte_carlo.rave)
     AlgorithmParams(std::string params_s="");
     enum class search_t
       { whole_tree, pruning, pruning_and_transposition, monte_carlo }
@@ -102,6 +138,7 @@ namespace sxako {
     } window;
 
     int level=2;
+    int timed_level=0;
     struct boldness_t {
       int depth=6;
       score_t score=.5;
@@ -113,10 +150,25 @@ namespace sxako {
       float deviation=.01;
       float max_factor=2.5;
     } random;
+
+    struct monte_carlo_t {
+      score_t exploration=1.41f; // about sqrt(2)
+      size_t max_nodes=1<<20;
+      unsigned threads=1;
+      enum class parallel_t { tree, root } parallel=parallel_t::tree;
+      bool graph=false;
+      score_t widening=0., widening_exponent=.5;
+      unsigned playout_length=0;
+      score_t playout_scale=2.;
+      bool solver=true;
+      score_t rave=0.;
+    } monte_carlo;
   };
 
   bool operator==(const AlgorithmParams &, const AlgorithmParams &);
 
+  class MonteCarloTree;
+
   class ComputerPlayer
     : public Player {
   public:
@@ -128,9 +180,16 @@ namespace sxako {
     evaluation_function_t const eval;
     AlgorithmParams const algo_params;
   private:
+    // time to spend on the next move, when playing on time: the "soft" limit
+    // is the time we'd like to use, the "hard" limit is the one we never
+    // exceed
+    struct time_budget_t { seconds_t soft, hard; };
+    time_budget_t time_budget() const;
     MoveScore get_move_tree_search(Game const &g);
     MoveScore get_move_monte_carlo(Game const &g);
     score_t last_best_score=0.; // for search windows
+    // the tree from the last Monte Carlo search, to be reused by the next one
+    std::shared_ptr<MonteCarloTree> monte_carlo_tree;
     random_generator_t random;
   };
 
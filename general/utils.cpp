@@ -15,6 +15,20 @@ namespace sxako {
     template <typename T>
     T round_score(T s) { return round(s*1000.)/1000.; }
 
+    string display_clock(Clock const &clock)
+      { return " ["+to_text(round(clock.remaining()*10.)/10.)+" s]"; }
+
+    // a line of moves, starting from the game's current board
+    string display_line(Game const &g, Moves const &line) {
+      string result;
+      Board b=g.board();
+      for (auto const &m: line) {
+        result+=" "+g.write_move(b, m);
+        g.move(b, m);
+      }
+      return result;
+    }
+
   }
 
   string match_up(GameSetup gs, function<bool ()> go_on) {
@@ -24,13 +38,29 @@ namespace sxako {
     while (g.outcome()==Rules::Outcome::playing and go_on()) {
       if (gs.help_move)
         gs.message_output(display_moves(g, g.legal_moves())+"\n");
+      auto const &clock=turn_player->clock;
+      if (clock)
+        clock->start();
       auto move_score=turn_player->get_move(g);
+      bool in_time=not clock or clock->stop();
       if (move_score.move.size()==0) // an empty move signals a game abort
         break;
+      if (not in_time) {
+        gs.message_output("\""+turn_player->name+"\" lost on time ("
+                          +to_text(g.last_move().number)+" moves)\n");
+        return wait_player->name;
+      }
+      string stats_s;
+      if (gs.stats and not move_score.pv.empty())
+        stats_s="  pv:"+display_line(g, move_score.pv)+"\n";
+      if (gs.stats)
+        stats_s+=move_score.report;
       g.move(move_score.move);
       gs.message_output(to_text(g.last_move().number)+": "
                         +g.write_move(move_score.move)
-                        +" ("+to_text(round_score(move_score.score))+")\n");
+                        +" ("+to_text(round_score(move_score.score))+")"
+                        +(clock ? display_clock(*clock) : "")+"\n"
+                        +stats_s);
       gs.board_output(g.display_board(gs.display_style));
       swap(turn_player, wait_player);
     }
@@ -86,6 +116,12 @@ namespace sxako {
     app.add_flag("-s,--stats", stats,
                  "show stats at the end");
 
+    string a_time_control_s, b_time_control_s;
+    app.add_option("-T,--a-time", a_time_control_s,
+                   "time control for player A (\"[moves/]seconds[+inc]\")");
+    app.add_option("-t,--b-time", b_time_control_s,
+                   "time control for player B (\"[moves/]seconds[+inc]\")");
+
     string rules_name="chess";
     app.add_option("-r,--rules", rules_name,
                    "select game rules",
@@ -185,6 +221,10 @@ namespace sxako {
         "computer b",
         game_spec.evaluation(b_evaluation),
         b_algo_params);
+    if (not a_time_control_s.empty())
+      player_a->clock=make_shared<Clock>(TimeControl(a_time_control_s));
+    if (not b_time_control_s.empty())
+      player_b->clock=make_shared<Clock>(TimeControl(b_time_control_s));
 
     return {game, player_a, player_b,
             display_style,